@@ -0,0 +1,543 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Write gzip, BGZF and zstd files by blocks compressed in parallel
+// ============================================================================
+#ifndef APP_HMNTRIMMER_BLOCK_OUT_H_
+#define APP_HMNTRIMMER_BLOCK_OUT_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#if SEQAN_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#if SEQAN_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
+#include <seqan/seq_io.h>
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+#include "kernels.hpp"
+
+using namespace seqan;
+
+// ============================================================================
+// Enum
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Enum block format
+// ----------------------------------------------------------------------------
+
+enum class BlockFormat : unsigned
+{
+    Gzip,
+    Bgzf,
+    Zstd
+};
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class BlockFileOut
+// ----------------------------------------------------------------------------
+
+// A FASTQ file written as a series of gzip members or zstd frames.  Records
+// are formatted to text, cut in blocks of blockSize bytes and the blocks
+// compressed on threads threads, so the file is the same whatever the number
+// of threads for one compressor, igzip or zlib.  BGZF files are members of 0xff00 bytes at most, with their
+// size in the header.  Level is the zstd compression level.
+struct BlockFileOut
+{
+    std::ofstream           file;
+    CharString              text;
+    String<CharString>      members;
+    std::size_t             blockSize;
+    unsigned                threads;
+    int                     level;
+    BlockFormat             format;
+    bool                    isEmpty;
+
+    BlockFileOut() :
+        file(),
+        text(),
+        members(),
+        blockSize(1 << 20),
+        threads(1),
+        level(3),
+        format(BlockFormat::Gzip),
+        isEmpty(true)
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function gzipCrc()
+// ----------------------------------------------------------------------------
+
+#if SEQAN_HAS_ZLIB
+#ifdef HMNTRIMMER_X86
+// Lane x folded 128 bits forward by the constants k, over the next lane.
+__attribute__((target("pclmul,sse4.1")))
+inline __m128i _gzipCrcFold(__m128i x, __m128i k, unsigned char const * next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+        _mm_clmulepi64_si128(x, k, 0x00)),
+        _mm_loadu_si128(reinterpret_cast<__m128i const *>(next)));
+}
+
+__attribute__((target("pclmul,sse4.1")))
+inline __m128i _gzipCrcFold(__m128i x, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+        _mm_clmulepi64_si128(x, k, 0x00)), next);
+}
+
+// CRC-32 of [data, data + size), size a multiple of 16 and 64 at least, from
+// the inverted crc. Blocks of 64 bytes are folded by carry-less products into
+// four lanes of 128 bits, folded to one then reduced by Barrett, as igzip
+// does.
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t _gzipCrcFolded(uint32_t crc, unsigned char const * data,
+std::size_t size)
+{
+    __m128i const k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    __m128i const k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    __m128i const k5 = _mm_set_epi64x(0, 0x0163cd6124);
+    __m128i const poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    __m128i const low = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x[4];
+    for (unsigned i = 0; i < 4; ++i)
+        x[i] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data) + i);
+    x[0] = _mm_xor_si128(x[0], _mm_cvtsi32_si128(int(crc)));
+    for (data += 64, size -= 64; size >= 64; data += 64, size -= 64)
+        for (unsigned i = 0; i < 4; ++i)
+            x[i] = _gzipCrcFold(x[i], k1k2, data + 16 * i);
+
+    __m128i y = x[0];
+    for (unsigned i = 1; i < 4; ++i)
+        y = _gzipCrcFold(y, k3k4, x[i]);
+    for (; size >= 16; data += 16, size -= 16)
+        y = _gzipCrcFold(y, k3k4, data);
+
+    // 128 to 64 bits, 64 to 32 bits, then Barrett reduction.
+    y = _mm_xor_si128(_mm_srli_si128(y, 8),
+        _mm_clmulepi64_si128(y, k3k4, 0x10));
+    y = _mm_xor_si128(_mm_srli_si128(y, 4),
+        _mm_clmulepi64_si128(_mm_and_si128(y, low), k5, 0x00));
+    __m128i q = _mm_clmulepi64_si128(_mm_and_si128(y, low), poly, 0x10);
+    q = _mm_clmulepi64_si128(_mm_and_si128(q, low), poly, 0x00);
+    return uint32_t(_mm_extract_epi32(_mm_xor_si128(y, q), 1));
+}
+#endif
+
+// CRC-32 of gzip members, crc32() of zlib continued from crc, folded with
+// PCLMULQDQ on the CPUs which have it.
+inline uint32_t gzipCrc(uint32_t crc, char const * data, std::size_t size)
+{
+    unsigned char const * bytes =
+        reinterpret_cast<unsigned char const *>(data);
+#ifdef HMNTRIMMER_X86
+    static bool const hasFold = []()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul") &&
+            __builtin_cpu_supports("sse4.1");
+    }();
+    if (hasFold && size >= 64)
+    {
+        std::size_t folded = size & ~std::size_t(15);
+        crc = ~_gzipCrcFolded(~crc, bytes, folded);
+        bytes += folded;
+        size -= folded;
+    }
+#endif
+    return crc32(crc, bytes, size);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Function compressBlock()
+// ----------------------------------------------------------------------------
+
+// Compress [data, data + size) to one gzip member, with igzip when available.
+inline bool compressBlock(CharString & member, char const * data,
+std::size_t size)
+{
+#if SEQAN_HAS_IGZIP
+    std::unique_ptr<LZ_Stream2> stream(new LZ_Stream2);
+    init_stream(stream.get());
+    stream->end_of_stream = 1;
+    stream->next_in = reinterpret_cast<UINT8 *>(const_cast<char *>(data));
+    stream->avail_in = size;
+
+    std::size_t written = 0;
+    resize(member, size + size / 8 + 1024);
+    while (true)
+    {
+        stream->next_out = reinterpret_cast<UINT8 *>(&member[0]) + written;
+        stream->avail_out = length(member) - written;
+        fast_lz(stream.get());
+        written = length(member) - stream->avail_out;
+        if (stream->avail_out != 0)
+            break;
+        resize(member, 2 * length(member));
+    }
+    resize(member, written);
+    return true;
+#elif SEQAN_HAS_ZLIB
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    resize(member, deflateBound(&stream, size));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = size;
+    stream.next_out = reinterpret_cast<Bytef *>(&member[0]);
+    stream.avail_out = length(member);
+    int status = deflate(&stream, Z_FINISH);
+    resize(member, stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+#else
+    ignoreUnusedVariableWarning(member);
+    ignoreUnusedVariableWarning(data);
+    ignoreUnusedVariableWarning(size);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function compressBgzfBlock()
+// ----------------------------------------------------------------------------
+
+// Compress [data, data + size) to one BGZF member, stored when it does not
+// fit in 64 KB compressed.
+inline bool compressBgzfBlock(CharString & member, char const * data,
+std::size_t size)
+{
+#if SEQAN_HAS_ZLIB
+    static const unsigned char header[16] =
+        {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+    std::size_t const maxSize = 1 << 16;
+
+    for (int level = Z_DEFAULT_COMPRESSION; ; level = Z_NO_COMPRESSION)
+    {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+
+        resize(member, 18 + deflateBound(&stream, size) + 8);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = size;
+        stream.next_out = reinterpret_cast<Bytef *>(&member[18]);
+        stream.avail_out = length(member) - 18 - 8;
+        int status = deflate(&stream, Z_FINISH);
+        std::size_t total = 18 + stream.total_out + 8;
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END)
+            return false;
+        if (total > maxSize && level != Z_NO_COMPRESSION)
+            continue;
+        if (total > maxSize)
+            return false;
+
+        std::memcpy(&member[0], header, 16);
+        member[16] = (total - 1) & 0xff;
+        member[17] = (total - 1) >> 8;
+        uint32_t crc = gzipCrc(0, data, size);
+        char * trailer = &member[18 + stream.total_out];
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            trailer[i] = (crc >> (8 * i)) & 0xff;
+            trailer[4 + i] = (size >> (8 * i)) & 0xff;
+        }
+        resize(member, total);
+        return true;
+    }
+#else
+    ignoreUnusedVariableWarning(member);
+    ignoreUnusedVariableWarning(data);
+    ignoreUnusedVariableWarning(size);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function compressZstdBlock()
+// ----------------------------------------------------------------------------
+
+// Compress [data, data + size) to one zstd frame with its size and checksum.
+inline bool compressZstdBlock(CharString & frame, char const * data,
+std::size_t size, int level)
+{
+#if SEQAN_HAS_ZSTD
+    ZSTD_CCtx * context = ZSTD_createCCtx();
+    if (context == NULL)
+        return false;
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+    resize(frame, ZSTD_compressBound(size));
+    std::size_t written = ZSTD_compress2(context, &frame[0], length(frame),
+        data, size);
+    ZSTD_freeCCtx(context);
+    if (ZSTD_isError(written))
+        return false;
+    resize(frame, written);
+    return true;
+#else
+    ignoreUnusedVariableWarning(frame);
+    ignoreUnusedVariableWarning(data);
+    ignoreUnusedVariableWarning(size);
+    ignoreUnusedVariableWarning(level);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function compressBlock()
+// ----------------------------------------------------------------------------
+
+inline bool compressBlock(BlockFileOut const & me, CharString & member,
+char const * data, std::size_t size)
+{
+    switch (me.format)
+    {
+        case BlockFormat::Bgzf:
+            return compressBgzfBlock(member, data, size);
+        case BlockFormat::Zstd:
+            return compressZstdBlock(member, data, size, me.level);
+        default:
+            return compressBlock(member, data, size);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function flushBlocks()
+// ----------------------------------------------------------------------------
+
+// Compress and write the full blocks of text, and the last partial one when
+// isLast.  The rest is kept for the next records.
+inline void flushBlocks(BlockFileOut & me, bool isLast)
+{
+    std::size_t size = length(me.text);
+    int blocks = size / me.blockSize;
+    if (isLast && size % me.blockSize != 0)
+        ++blocks;
+    if (blocks == 0)
+        return;
+
+    resize(me.members, blocks);
+    std::atomic<bool> isFailed(false);
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int block = 0; block < blocks; ++block)
+    {
+        std::size_t from = block * me.blockSize;
+        if (!compressBlock(me, me.members[block], toCString(me.text) + from,
+            std::min(me.blockSize, size - from)))
+            isFailed = true;
+    }
+    if (isFailed)
+        throw IOError("Error while compressing reads file.");
+
+    for (int block = 0; block < blocks; ++block)
+        me.file.write(toCString(me.members[block]), length(me.members[block]));
+    if (!me.file.good())
+        throw IOError("Error while writing reads file.");
+    me.isEmpty = false;
+
+    erase(me.text, 0, std::min<std::size_t>(size, blocks * me.blockSize));
+}
+
+// ----------------------------------------------------------------------------
+// Function isGzipName()
+// ----------------------------------------------------------------------------
+
+inline bool isGzipName(char const * fileName)
+{
+    std::size_t len = std::strlen(fileName);
+    return len >= 3 && std::strcmp(fileName + len - 3, ".gz") == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function isBgzfName()
+// ----------------------------------------------------------------------------
+
+inline bool isBgzfName(char const * fileName)
+{
+    std::size_t len = std::strlen(fileName);
+    return len >= 4 && std::strcmp(fileName + len - 4, ".bgz") == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function isZstdName()
+// ----------------------------------------------------------------------------
+
+inline bool isZstdName(char const * fileName)
+{
+    std::size_t len = std::strlen(fileName);
+    return len >= 4 && std::strcmp(fileName + len - 4, ".zst") == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function isOpen()
+// ----------------------------------------------------------------------------
+
+inline bool isOpen(BlockFileOut const & me)
+{
+    return me.file.is_open();
+}
+
+// ----------------------------------------------------------------------------
+// Function setThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the team compressing the next blocks, the file may be open.
+inline void setThreads(BlockFileOut & me, unsigned threads)
+{
+    me.threads = threads;
+}
+
+// ----------------------------------------------------------------------------
+// Function open()
+// ----------------------------------------------------------------------------
+
+// Open files named *.gz, *.bgz or *.zst only, when their compression is
+// built in.  The others are left to a SeqFileOut.
+inline bool open(BlockFileOut & me, char const * fileName)
+{
+    bool isBuilt = false;
+    if (isGzipName(fileName))
+    {
+        me.format = BlockFormat::Gzip;
+#if SEQAN_HAS_IGZIP || SEQAN_HAS_ZLIB
+        isBuilt = true;
+#endif
+    }
+    else if (isBgzfName(fileName))
+    {
+        me.format = BlockFormat::Bgzf;
+#if SEQAN_HAS_ZLIB
+        isBuilt = true;
+#endif
+    }
+    else if (isZstdName(fileName))
+    {
+        me.format = BlockFormat::Zstd;
+#if SEQAN_HAS_ZSTD
+        isBuilt = true;
+#endif
+    }
+    if (!isBuilt)
+        return false;
+
+    me.blockSize = me.format == BlockFormat::Bgzf ? 0xff00 : 1 << 20;
+    me.file.open(fileName, std::ios::binary | std::ios::trunc);
+    me.isEmpty = true;
+    clear(me.text);
+    return me.file.is_open();
+}
+
+template <typename TSpec>
+inline bool open(Pair<BlockFileOut, TSpec> & me,
+        const char * fileName1,
+        const char * fileName2)
+{
+    if (open(me.i1, fileName1) && open(me.i2, fileName2))
+        return true;
+    close(me.i1);
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Function close()
+// ----------------------------------------------------------------------------
+
+// Write the last block, an empty member if nothing was written at all.  BGZF
+// files end with an empty member, the end of file marker.
+inline void close(BlockFileOut & me)
+{
+    if (!isOpen(me))
+        return;
+    flushBlocks(me, true);
+    if (me.format == BlockFormat::Bgzf)
+    {
+        static const char eof[28] =
+            {0x1f, char(0x8b), 8, 4, 0, 0, 0, 0, 0, char(0xff), 6, 0, 'B', 'C',
+             2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        me.file.write(eof, 28);
+    }
+    else if (me.isEmpty)
+    {
+        CharString member;
+        if (!compressBlock(me, member, "", 0))
+            throw IOError("Error while compressing reads file.");
+        me.file.write(toCString(member), length(member));
+    }
+    me.file.close();
+    clear(me.text);
+    clear(me.members);
+}
+
+// ----------------------------------------------------------------------------
+// Function writeRecord()
+// ----------------------------------------------------------------------------
+
+template <typename TName, typename TSeq>
+inline void writeRecord(BlockFileOut & me, TName const & name, TSeq const & seq)
+{
+    writeRecord(me.text, name, seq, Fastq());
+    if (length(me.text) >= me.threads * std::max<std::size_t>(me.blockSize,
+        1 << 20))
+        flushBlocks(me, false);
+}
+
+// ----------------------------------------------------------------------------
+// Function writeRecords()
+// ----------------------------------------------------------------------------
+
+template <typename TNames, typename TSeqs>
+inline void writeRecords(BlockFileOut & me, TNames const & names,
+TSeqs const & seqs)
+{
+    for (unsigned pos = 0; pos < length(names); ++pos)
+        writeRecord(me.text, names[pos], seqs[pos], Fastq());
+    flushBlocks(me, false);
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_BLOCK_OUT_H_
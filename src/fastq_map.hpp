@@ -0,0 +1,802 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Read plain FASTQ files through a memory map
+// ============================================================================
+#ifndef APP_HMNTRIMMER_FASTQ_MAP_H_
+#define APP_HMNTRIMMER_FASTQ_MAP_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+// ----------------------------------------------------------------------------
+// App headers
+// ----------------------------------------------------------------------------
+
+#include "kernels.hpp"
+
+using namespace seqan;
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class FastqView
+// ----------------------------------------------------------------------------
+
+// One record as ranges of the mapped bytes.  The sequence and the qualities
+// are [seq, seqEnd) and [qual, qualEnd), with line breaks inside when the
+// record spans several lines, and hold length bases each.
+struct FastqView
+{
+    char const *    name;
+    char const *    nameEnd;
+    char const *    seq;
+    char const *    seqEnd;
+    char const *    qual;
+    char const *    qualEnd;
+    unsigned        length;
+
+    FastqView() :
+        name(NULL),
+        nameEnd(NULL),
+        seq(NULL),
+        seqEnd(NULL),
+        qual(NULL),
+        qualEnd(NULL),
+        length(0)
+    {};
+};
+
+// ----------------------------------------------------------------------------
+// Class FastqMap
+// ----------------------------------------------------------------------------
+
+// A FASTQ file mapped read-only, read from pos to the end.  Pages before
+// released are given back to the kernel.  With several threads, records are
+// parsed by chunks of bytes into views, then copied in file order.  Without
+// fd, data is a buffer filled by the owner; when isPartial, more text follows
+// it and a record reaching its end is left for the next fill.  Records are
+// read up to size, mapSize bytes being mapped.
+struct FastqMap
+{
+    char const *    data;
+    std::size_t     size;
+    std::size_t     mapSize;
+    std::size_t     pos;
+    std::size_t     released;
+    unsigned long   records;
+    unsigned long   recordBytes;
+    unsigned        threads;
+    int             fd;
+    bool            isPartial;
+
+    String<char const *>        bounds;
+    String<String<FastqView> >  views;
+
+    FastqMap() :
+        data(NULL),
+        size(0),
+        mapSize(0),
+        pos(0),
+        released(0),
+        records(0),
+        recordBytes(0),
+        threads(1),
+        fd(-1),
+        isPartial(false),
+        bounds(),
+        views()
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function mapFile()
+// ----------------------------------------------------------------------------
+
+// Map a regular file read-only.  Fails on pipes and devices.
+inline bool mapFile(char const * & data, std::size_t & size, int & fd,
+char const * fileName)
+{
+    data = NULL;
+    size = 0;
+    fd = -1;
+#ifdef __linux__
+    int file = ::open(fileName, O_RDONLY);
+    if (file == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(file, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(file);
+        return false;
+    }
+
+    if (st.st_size > 0)
+    {
+        void * mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(file);
+            return false;
+        }
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<char const *>(mapped);
+    }
+    size = st.st_size;
+    fd = file;
+    return true;
+#else
+    ignoreUnusedVariableWarning(fileName);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function unmapFile()
+// ----------------------------------------------------------------------------
+
+inline void unmapFile(char const * data, std::size_t size, int fd)
+{
+#ifdef __linux__
+    if (fd == -1)
+        return;
+    if (data != NULL)
+        munmap(const_cast<char *>(data), size);
+    ::close(fd);
+#else
+    ignoreUnusedVariableWarning(data);
+    ignoreUnusedVariableWarning(size);
+    ignoreUnusedVariableWarning(fd);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function isOpen()
+// ----------------------------------------------------------------------------
+
+inline bool isOpen(FastqMap const & me)
+{
+    return me.fd != -1;
+}
+
+// ----------------------------------------------------------------------------
+// Function setThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the team parsing the next records, the file may be open.
+inline void setThreads(FastqMap & me, unsigned threads)
+{
+    me.threads = threads;
+}
+
+// ----------------------------------------------------------------------------
+// Function close()
+// ----------------------------------------------------------------------------
+
+inline void close(FastqMap & me)
+{
+    unmapFile(me.data, me.mapSize, me.fd);
+    unsigned threads = me.threads;
+    me = FastqMap();
+    me.threads = threads;
+}
+
+// ----------------------------------------------------------------------------
+// Function open()
+// ----------------------------------------------------------------------------
+
+// Map a plain FASTQ file.  Fails on anything else (pipes, compressed files)
+// so that the caller falls back to a SeqFileIn.
+inline bool open(FastqMap & me, char const * fileName)
+{
+    close(me);
+    if (!mapFile(me.data, me.size, me.fd, fileName))
+        return false;
+    me.mapSize = me.size;
+
+    // A FASTQ file starts with its first record, compressed files do not.
+    if (me.size > 0 && me.data[0] != '@')
+    {
+        close(me);
+        return false;
+    }
+    return true;
+}
+
+template <typename TSpec>
+inline bool open(Pair<FastqMap, TSpec> & me,
+        const char * fileName1,
+        const char * fileName2)
+{
+    if (open(me.i1, fileName1) && open(me.i2, fileName2))
+        return true;
+    close(me.i1);
+    close(me.i2);
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Function atEnd()
+// ----------------------------------------------------------------------------
+
+inline bool atEnd(FastqMap const & me)
+{
+    return me.pos >= me.size;
+}
+
+// ----------------------------------------------------------------------------
+// Function releaseRead()
+// ----------------------------------------------------------------------------
+
+// Drop the pages read so far from the process, they are not read twice.
+inline void releaseRead(FastqMap & me)
+{
+#ifdef __linux__
+    if (me.fd == -1)
+        return;
+    std::size_t page = sysconf(_SC_PAGESIZE);
+    std::size_t upto = me.pos / page * page;
+    if (upto > me.released)
+    {
+        madvise(const_cast<char *>(me.data) + me.released,
+            upto - me.released, MADV_DONTNEED);
+        me.released = upto;
+    }
+#else
+    ignoreUnusedVariableWarning(me);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function findNewline()
+// ----------------------------------------------------------------------------
+
+// First '\n' of [it, end), end if none.  Sixteen bytes are compared at once.
+inline char const * findNewline(char const * it, char const * end)
+{
+#ifdef __SSE2__
+    __m128i const newline = _mm_set1_epi8('\n');
+    for (; end - it >= 16; it += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(it));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (mask != 0)
+            return it + __builtin_ctz(mask);
+    }
+#endif
+    void const * found = std::memchr(it, '\n', end - it);
+    return found != NULL ? static_cast<char const *>(found) : end;
+}
+
+// ----------------------------------------------------------------------------
+// Function lineEnd()
+// ----------------------------------------------------------------------------
+
+// End of the line starting at it, without its "\n" or "\r\n".
+inline char const * lineEnd(char const * it, char const * eol)
+{
+    return (eol > it && *(eol - 1) == '\r') ? eol - 1 : eol;
+}
+
+// ----------------------------------------------------------------------------
+// Function nextLine()
+// ----------------------------------------------------------------------------
+
+inline char const * nextLine(char const * eol, char const * end)
+{
+    return eol < end ? eol + 1 : end;
+}
+
+// ----------------------------------------------------------------------------
+// Function isFastqSpace()
+// ----------------------------------------------------------------------------
+
+inline bool isFastqSpace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// ----------------------------------------------------------------------------
+// Function readRecord()
+// ----------------------------------------------------------------------------
+
+// Parse the record at it as SeqAn does: the sequence runs until the '+' line
+// and the qualities are as many non blank characters as bases.  On return, it
+// is on the next record.  Returns false at the end of the file.
+inline bool readRecord(FastqView & view, char const * & it, char const * end)
+{
+    // Forward to the next '@'.
+    void const * at = std::memchr(it, '@', end - it);
+    if (at == NULL)
+    {
+        it = end;
+        return false;
+    }
+    it = static_cast<char const *>(at) + 1;
+
+    // Name.
+    char const * eol = findNewline(it, end);
+    view.name = it;
+    view.nameEnd = lineEnd(it, eol);
+    it = nextLine(eol, end);
+
+    // Sequence, on one line or more.
+    view.seq = it;
+    unsigned lines = 0;
+    while (it < end && *it != '+')
+    {
+        eol = findNewline(it, end);
+        view.seqEnd = lineEnd(it, eol);
+        it = nextLine(eol, end);
+        ++lines;
+    }
+    if (it == end)
+        throw ParseError("Fastq record is expected to have qualities! "
+                         "But was not.");
+    if (lines == 0)
+        view.seqEnd = view.seq;
+    if (lines > 1)
+    {
+        view.seqEnd = it;
+        view.length = std::count_if(view.seq, view.seqEnd,
+            [](char c) { return !isFastqSpace(c); });
+    }
+    else
+    {
+        view.length = view.seqEnd - view.seq;
+    }
+
+    // Skip the optional second name.
+    eol = findNewline(it, end);
+    it = nextLine(eol, end);
+
+    // Qualities, on one line when its length matches the sequence.
+    view.qual = it;
+    eol = findNewline(it, end);
+    view.qualEnd = lineEnd(it, eol);
+    if (static_cast<unsigned>(view.qualEnd - view.qual) != view.length)
+    {
+        unsigned count = 0;
+        for (view.qualEnd = view.qual; count < view.length &&
+            view.qualEnd < end; ++view.qualEnd)
+        {
+            if (!isFastqSpace(*view.qualEnd))
+                ++count;
+        }
+        eol = view.qualEnd;
+    }
+
+    // The next record follows immediately.
+    it = eol;
+    while (it < end && isFastqSpace(*it))
+        ++it;
+    if (it < end && *it != '@')
+        throw ParseError("Fastq quality string is expected to be of the same "
+                         "length as the sequence! But was not.");
+    return true;
+}
+
+inline bool readRecord(FastqView & view, FastqMap & me)
+{
+    if (atEnd(me))
+        return false;
+    char const * end = me.data + me.size;
+    char const * it = me.data + me.pos;
+    bool isRead = false;
+    try
+    {
+        isRead = readRecord(view, it, end);
+    }
+    catch (ParseError const &)
+    {
+        // Only a record cut by the end of a partial buffer is not an error.
+        if (!me.isPartial || it != end)
+            throw;
+        return false;
+    }
+
+    // The record, or the blanks after it, may go on in the next fill.
+    if (me.isPartial && it == end)
+        return false;
+
+    me.recordBytes += (it - me.data) - me.pos;
+    me.pos = it - me.data;
+    me.records += isRead;
+    return isRead;
+}
+
+// ----------------------------------------------------------------------------
+// Function findRecordStart()
+// ----------------------------------------------------------------------------
+
+// First record starting on a line at or after it.  A record starts on a line
+// beginning with '@' whose line after next begins with '+'.  A quality line
+// beginning with '@' is followed by a name then a sequence, so it never
+// matches.  Multi-line records may match anywhere, the caller checks that
+// chunks end where the next one starts.
+inline char const *
+findRecordStart(char const * it, char const * begin, char const * end)
+{
+    if (it > begin && *(it - 1) != '\n')
+        it = nextLine(findNewline(it, end), end);
+    for (; it < end; it = nextLine(findNewline(it, end), end))
+    {
+        if (*it != '@')
+            continue;
+        char const * line = nextLine(findNewline(it, end), end);
+        line = nextLine(findNewline(line, end), end);
+        if (line < end && *line == '+')
+            return it;
+    }
+    return end;
+}
+
+// ----------------------------------------------------------------------------
+// Function countLines()
+// ----------------------------------------------------------------------------
+
+// Newlines in the bytes [from, to), counted by chunks on all the threads.
+inline uint64_t countLines(FastqMap const & me, std::size_t from,
+std::size_t to)
+{
+    std::size_t const chunk = 1 << 24;
+    int chunks = from < to ? (to - from + chunk - 1) / chunk : 0;
+    uint64_t lines = 0;
+    SEQAN_OMP_PRAGMA(parallel for reduction(+:lines) num_threads(me.threads))
+    for (int c = 0; c < chunks; ++c)
+    {
+        char const * it = me.data + from + c * chunk;
+        lines += std::count(it, me.data + std::min(to, from + (c + 1) * chunk),
+            '\n');
+    }
+    return lines;
+}
+
+// ----------------------------------------------------------------------------
+// Function findLine()
+// ----------------------------------------------------------------------------
+
+// Byte after lines newlines from the byte from, the end when there are
+// fewer.  Rounds of chunks are counted on all the threads, then the lines
+// of the last round are walked.
+inline std::size_t findLine(FastqMap const & me, std::size_t from,
+uint64_t lines)
+{
+    std::size_t const round = std::size_t(me.threads) << 24;
+    while (from < me.size)
+    {
+        std::size_t to = std::min(me.size, from + round);
+        uint64_t count = countLines(me, from, to);
+        if (count >= lines)
+            break;
+        lines -= count;
+        from = to;
+    }
+
+    char const * end = me.data + me.size;
+    char const * it = me.data + std::min(from, me.size);
+    for (; lines > 0 && it < end; --lines)
+        it = nextLine(findNewline(it, end), end);
+    return it - me.data;
+}
+
+// ----------------------------------------------------------------------------
+// Function setRange()
+// ----------------------------------------------------------------------------
+
+// Read the records of the bytes [from, to) only, from being a record start.
+inline void setRange(FastqMap & me, std::size_t from, std::size_t to)
+{
+    me.pos = std::min(from, me.size);
+    me.size = std::max(me.pos, std::min(to, me.size));
+}
+
+// ----------------------------------------------------------------------------
+// Function encodeRecord()
+// ----------------------------------------------------------------------------
+
+template <typename TSeqIt>
+inline void
+_encodeBases(TSeqIt out, FastqView const & view)
+{
+    typedef typename Value<TSeqIt>::Type                    TAlphabet;
+
+    for (unsigned i = 0; i < view.length; ++i, ++out)
+    {
+        *out = TAlphabet(view.seq[i]);
+        assignQualityValue(*out, view.qual[i]);
+    }
+}
+
+// Values of Dna5Q are bytes, encoded by the kernel of the CPU.
+inline void
+_encodeBases(Dna5Q * out, FastqView const & view)
+{
+    simdKernels().encodeBases(reinterpret_cast<unsigned char *>(out),
+        view.seq, view.qual, view.length);
+}
+
+// Copy the name to nameOut and encode the bases with their qualities to
+// seqOut, straight from the mapped bytes.
+template <typename TNameIt, typename TSeqIt>
+inline void
+encodeRecord(TNameIt nameOut, TSeqIt out, FastqView const & view)
+{
+    typedef typename Value<TSeqIt>::Type                    TAlphabet;
+
+    std::copy(view.name, view.nameEnd, nameOut);
+    if (static_cast<unsigned>(view.seqEnd - view.seq) == view.length &&
+        static_cast<unsigned>(view.qualEnd - view.qual) == view.length)
+    {
+        _encodeBases(out, view);
+    }
+    else
+    {
+        char const * base = view.seq;
+        char const * qual = view.qual;
+        for (unsigned i = 0; i < view.length; ++i, ++out)
+        {
+            while (isFastqSpace(*base))
+                ++base;
+            while (isFastqSpace(*qual))
+                ++qual;
+            *out = TAlphabet(*base++);
+            assignQualityValue(*out, *qual++);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function appendRecord()
+// ----------------------------------------------------------------------------
+
+template <typename TName, typename TNameSpec, typename TSeq, typename TSeqSpec>
+inline void
+appendRecord(StringSet<TName, Owner<ConcatDirect<TNameSpec> > > & names,
+StringSet<TSeq, Owner<ConcatDirect<TSeqSpec> > > & seqs,
+FastqView const & view)
+{
+    std::size_t nameFrom = length(names.concat);
+    std::size_t seqFrom = length(seqs.concat);
+    resize(names.concat, nameFrom + (view.nameEnd - view.name));
+    resize(seqs.concat, seqFrom + view.length);
+    encodeRecord(begin(names.concat, Standard()) + nameFrom,
+        begin(seqs.concat, Standard()) + seqFrom, view);
+    appendValue(names.limits, length(names.concat));
+    appendValue(seqs.limits, length(seqs.concat));
+}
+
+// ----------------------------------------------------------------------------
+// Function appendRecords()
+// ----------------------------------------------------------------------------
+
+// Append the first counts[c] views of each chunk c, in chunk order.  Arenas
+// are grown once, then each chunk is encoded at its offsets by its own
+// thread.
+template <typename TName, typename TNameSpec, typename TSeq, typename TSeqSpec,
+typename TCounts>
+inline void
+appendRecords(StringSet<TName, Owner<ConcatDirect<TNameSpec> > > & names,
+StringSet<TSeq, Owner<ConcatDirect<TSeqSpec> > > & seqs,
+String<String<FastqView> > const & views, TCounts const & counts,
+unsigned threads)
+{
+    typedef Triple<std::size_t>                             TOffset;
+
+    int chunks = length(counts);
+    String<TOffset> offsets;
+    resize(offsets, chunks + 1, TOffset(0, 0, 0), Exact());
+
+    SEQAN_OMP_PRAGMA(parallel for num_threads(threads))
+    for (int c = 0; c < chunks; ++c)
+    {
+        TOffset & size = offsets[c + 1];
+        size.i1 = counts[c];
+        for (std::size_t i = 0; i < counts[c]; ++i)
+        {
+            size.i2 += views[c][i].nameEnd - views[c][i].name;
+            size.i3 += views[c][i].length;
+        }
+    }
+
+    // Offsets of each chunk, after the reads already stored.
+    offsets[0].i1 = length(names.limits) - 1;
+    offsets[0].i2 = length(names.concat);
+    offsets[0].i3 = length(seqs.concat);
+    for (int c = 0; c < chunks; ++c)
+    {
+        offsets[c + 1].i1 += offsets[c].i1;
+        offsets[c + 1].i2 += offsets[c].i2;
+        offsets[c + 1].i3 += offsets[c].i3;
+    }
+    resize(names.limits, offsets[chunks].i1 + 1);
+    resize(seqs.limits, offsets[chunks].i1 + 1);
+    resize(names.concat, offsets[chunks].i2);
+    resize(seqs.concat, offsets[chunks].i3);
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(threads))
+    for (int c = 0; c < chunks; ++c)
+    {
+        TOffset at = offsets[c];
+        for (std::size_t i = 0; i < counts[c]; ++i)
+        {
+            FastqView const & view = views[c][i];
+            encodeRecord(begin(names.concat, Standard()) + at.i2,
+                begin(seqs.concat, Standard()) + at.i3, view);
+            at.i2 += view.nameEnd - view.name;
+            at.i3 += view.length;
+            ++at.i1;
+            names.limits[at.i1] = at.i2;
+            seqs.limits[at.i1] = at.i3;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function readRecords()
+// ----------------------------------------------------------------------------
+
+// Parse the bytes expected to hold maxRecords records with all threads.  The
+// bytes are cut in chunks moved forward to the next record start, each chunk
+// is parsed to views by one thread, then the views are appended in file
+// order.  Returns false, and reads nothing, when a chunk does not end where
+// the next one starts, as with multi-line records.
+template <typename TNames, typename TSeqs, typename TSize>
+inline bool
+_readRecordsChunks(TNames & names, TSeqs & seqs, FastqMap & me,
+TSize maxRecords, TSize & records)
+{
+    char const * begin = me.data;
+    char const * end = me.data + me.size;
+    char const * first = begin + me.pos;
+
+    // Bytes of the records asked at the mean size of the records read so
+    // far, plus some margin.  The end of a partial buffer is left to the
+    // serial parser.
+    std::size_t window = std::size_t(me.threads) << 20;
+    if (me.records > 0)
+        window = (me.recordBytes / me.records) * maxRecords / 16 * 17 + 4096;
+    char const * last = end;
+    if (static_cast<std::size_t>(end - first) > window)
+        last = findRecordStart(first + window, begin, end);
+    else if (me.isPartial)
+        last = findRecordStart(first + (end - first) / 8 * 7, begin, end);
+    if (me.isPartial && (last == end || last - first < (1 << 16)))
+        return false;
+
+    int chunks = std::max<int>(1, std::min<std::size_t>(me.threads * 4,
+        (last - first) >> 16));
+    resize(me.bounds, chunks + 1);
+    resize(me.views, chunks);
+    String<std::size_t> counts;
+    resize(counts, chunks, 0, Exact());
+    std::atomic<bool> isFailed(false);
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int c = 0; c <= chunks; ++c)
+    {
+        char const * at = first + (last - first) / chunks * c;
+        me.bounds[c] = c == 0 ? first : c == chunks ? last :
+            std::min(findRecordStart(at, begin, end), last);
+    }
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int c = 0; c < chunks; ++c)
+    {
+        String<FastqView> & views = me.views[c];
+        clear(views);
+        char const * it = me.bounds[c];
+        try
+        {
+            FastqView view;
+            while (it < me.bounds[c + 1] && readRecord(view, it, end))
+                appendValue(views, view);
+            if (it != me.bounds[c + 1])
+                isFailed = true;
+        }
+        catch (ParseError const &)
+        {
+            isFailed = true;
+        }
+    }
+    if (isFailed)
+        return false;
+
+    // Keep maxRecords records, the file is read up to the next one.
+    records = 0;
+    std::size_t from = me.pos;
+    me.pos = last - begin;
+    for (int c = 0; c < chunks; ++c)
+    {
+        counts[c] = std::min<std::size_t>(length(me.views[c]),
+            maxRecords - records);
+        records += counts[c];
+        if (counts[c] < length(me.views[c]))
+        {
+            me.pos = me.views[c][counts[c]].name - 1 - begin;
+            break;
+        }
+    }
+    me.records += records;
+    me.recordBytes += me.pos - from;
+
+    appendRecords(names, seqs, me.views, counts, me.threads);
+    return records > 0;
+}
+
+// Read maxRecords records at most into the arenas.  Chunks parsed in
+// parallel are given up for the serial parser at the first failure.
+template <typename TNames, typename TSeqs, typename TSize>
+inline void
+readRecords(TNames & names, TSeqs & seqs, FastqMap & me, TSize maxRecords)
+{
+    TSize count = 0;
+    TSize records = 0;
+    while (me.threads > 1 && count < maxRecords && !atEnd(me) &&
+        _readRecordsChunks(names, seqs, me, maxRecords - count, records))
+    {
+        count += records;
+    }
+
+    FastqView view;
+    for (; count < maxRecords && readRecord(view, me); ++count)
+        appendRecord(names, seqs, view);
+    releaseRead(me);
+}
+
+// ----------------------------------------------------------------------------
+// Function skipRecords()
+// ----------------------------------------------------------------------------
+
+// Parse count records at most without keeping them, returns their number.
+template <typename TSize>
+inline TSize skipRecords(FastqMap & me, TSize count)
+{
+    TSize skipped = 0;
+    FastqView view;
+    for (; skipped < count && readRecord(view, me); ++skipped) {}
+    releaseRead(me);
+    return skipped;
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_FASTQ_MAP_H_
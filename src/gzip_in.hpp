@@ -0,0 +1,1411 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Read gzip and BGZF files decompressed in parallel
+// ============================================================================
+#ifndef APP_HMNTRIMMER_GZIP_IN_H_
+#define APP_HMNTRIMMER_GZIP_IN_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if SEQAN_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+// ----------------------------------------------------------------------------
+// App headers
+// ----------------------------------------------------------------------------
+
+#include "fastq_map.hpp"
+#include "block_out.hpp"
+#include "gzip_index.hpp"
+
+using namespace seqan;
+
+// ============================================================================
+// Enum
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Enum Huffman entry
+// ----------------------------------------------------------------------------
+
+// Kinds of the entries of a GzipHuffman table.  Bits 0 to 4 of an entry are
+// the bits of its code, bits 5 to 8 the extra bits of a length or distance,
+// or the bits of a subtable, bits 16 to 31 the literal, the pair of literals,
+// the length or distance base, or the offset of a subtable.  Entries without
+// kind are literals.
+enum GzipEntry : uint32_t
+{
+    GzipLength = 1u << 9,
+    GzipEnd = 1u << 10,
+    GzipSubtable = 1u << 11,
+    GzipInvalid = 1u << 12,
+    GzipPair = 1u << 13
+};
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class GzipHuffman
+// ----------------------------------------------------------------------------
+
+// A canonical Huffman code of a deflate block, as a table indexed by the next
+// tableBits bits of the stream, bits being the longest code.  Longer codes go
+// on in subtables after the first 1 << tableBits entries, indexed by the bits
+// after.  Entries are the value of the symbol of the code, see GzipEntry.
+struct GzipHuffman
+{
+    String<uint32_t>    table;
+    unsigned            bits;
+    unsigned            tableBits;
+
+    GzipHuffman() :
+        table(),
+        bits(0),
+        tableBits(0)
+    {};
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipValues
+// ----------------------------------------------------------------------------
+
+// Entries of the symbols of the literal and length codes, of the distance
+// codes and of the code length codes, without their code bits.
+struct GzipValues
+{
+    uint32_t    lit[288];
+    uint32_t    dist[32];
+    uint32_t    lens[19];
+
+    GzipValues()
+    {
+        static const uint16_t lengthBase[29] =
+            {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43,
+             51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const unsigned char lengthExtra[29] =
+            {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4,
+             4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distBase[30] =
+            {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257,
+             385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+             16385, 24577};
+        static const unsigned char distExtra[30] =
+            {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,
+             10, 10, 11, 11, 12, 12, 13, 13};
+
+        for (unsigned symbol = 0; symbol < 256; ++symbol)
+            lit[symbol] = symbol << 16;
+        lit[256] = GzipEnd;
+        for (unsigned i = 0; i < 29; ++i)
+            lit[257 + i] = GzipLength | lengthExtra[i] << 5 |
+                uint32_t(lengthBase[i]) << 16;
+        lit[286] = lit[287] = GzipInvalid;
+        for (unsigned i = 0; i < 30; ++i)
+            dist[i] = distExtra[i] << 5 | uint32_t(distBase[i]) << 16;
+        dist[30] = dist[31] = GzipInvalid;
+        for (unsigned symbol = 0; symbol < 19; ++symbol)
+            lens[symbol] = symbol << 16;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipBits
+// ----------------------------------------------------------------------------
+
+// Compressed bytes read from bit pos, least significant bits first.
+struct GzipBits
+{
+    unsigned char const *   data;
+    std::size_t             size;
+    std::size_t             pos;
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipMemberEnd
+// ----------------------------------------------------------------------------
+
+// A member ending at offset in the output of a chunk, with its trailer.
+struct GzipMemberEnd
+{
+    std::size_t     offset;
+    uint32_t        crc;
+    uint32_t        isize;
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipChunk
+// ----------------------------------------------------------------------------
+
+// The decompression of the bits from start, a block or member header, to end,
+// the first of them at or after stop.  The output begins with the 32 KB window
+// before start.  When it is known, the output is bytes.  Otherwise values are
+// bytes, or 0x8000 | i for the byte i of the window, replaced once the chunks
+// before are decoded.  The member being decoded at start has crc and isize
+// before it.
+struct GzipChunk
+{
+    std::size_t             start;
+    std::size_t             stop;
+    std::size_t             end;
+    std::size_t             offset;
+    String<uint16_t>        out;
+    CharString              bytes;
+    std::size_t             outLength;
+    String<GzipMemberEnd>   ends;
+    String<uint32_t>        crcs;
+    CharString              window;
+    GzipHuffman             lit;
+    GzipHuffman             dist;
+    GzipHuffman             lens;
+    uint32_t                crc;
+    uint32_t                isize;
+    bool                    isKnown;
+    bool                    isEnd;
+    bool                    isFailed;
+
+    GzipChunk() :
+        start(0),
+        stop(0),
+        end(0),
+        offset(0),
+        out(),
+        bytes(),
+        outLength(0),
+        ends(),
+        crcs(),
+        window(),
+        lit(),
+        dist(),
+        lens(),
+        crc(0),
+        isize(0),
+        isKnown(false),
+        isEnd(false),
+        isFailed(false)
+    {};
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipFileIn
+// ----------------------------------------------------------------------------
+
+// A gzip FASTQ file mapped read-only and decompressed by rounds of chunkSize
+// compressed bytes per thread.  The first chunk of a round starts where the
+// previous round ended, the others at the first deflate block found in their
+// bytes.  A chunk is kept when the one before ends where it starts, so the
+// output is the one of a serial decompression.  The text is parsed as a
+// partial FastqMap refilled at each round.  In BGZF files, chunks start at
+// the members found from their sizes, member being the next one.  The
+// record at the text pos is the number recordBase plus the records parsed,
+// outSize bytes are decompressed before the round.  When isIndexing, a
+// checkpoint is added to index at the start of a kept chunk every span bytes,
+// the index being saved to indexFile once the file is read to its end.
+struct GzipFileIn
+{
+    unsigned char const *   data;
+    std::size_t             size;
+    int                     fd;
+    std::size_t             bitPos;
+    std::size_t             member;
+    bool                    isBgzf;
+    bool                    isEnd;
+    CharString              window;
+    CharString              buffer;
+    FastqMap                text;
+    String<GzipChunk>       chunks;
+    std::size_t             chunkSize;
+    unsigned                threads;
+    uint32_t                crc;
+    uint32_t                isize;
+    uint64_t                outSize;
+    uint64_t                recordBase;
+    GzipIndex               index;
+    CharString              indexFile;
+    bool                    isIndexing;
+
+    GzipFileIn() :
+        data(NULL),
+        size(0),
+        fd(-1),
+        bitPos(0),
+        member(0),
+        isBgzf(false),
+        isEnd(true),
+        window(),
+        buffer(),
+        text(),
+        chunks(),
+        chunkSize(1 << 20),
+        threads(1),
+        crc(0),
+        isize(0),
+        outSize(0),
+        recordBase(0),
+        index(),
+        indexFile(),
+        isIndexing(false)
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function peekBits()
+// ----------------------------------------------------------------------------
+
+// The next 57 bits at least, zeros past the end.
+inline uint64_t peekBits(GzipBits const & me)
+{
+    std::size_t at = me.pos >> 3;
+    uint64_t value = 0;
+    if (at + 8 <= me.size)
+    {
+        std::memcpy(&value, me.data + at, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        value = __builtin_bswap64(value);
+#endif
+    }
+    else
+    {
+        for (unsigned i = 0; at + i < me.size && i < 8; ++i)
+            value |= uint64_t(me.data[at + i]) << (8 * i);
+    }
+    return value >> (me.pos & 7);
+}
+
+// ----------------------------------------------------------------------------
+// Function readBits()
+// ----------------------------------------------------------------------------
+
+inline unsigned readBits(GzipBits & me, unsigned count)
+{
+    unsigned value = peekBits(me) & ((uint64_t(1) << count) - 1);
+    me.pos += count;
+    return value;
+}
+
+// ----------------------------------------------------------------------------
+// Function huffmanValues()
+// ----------------------------------------------------------------------------
+
+// Entries of the symbols of all the codes, shared by all the tables.
+inline GzipValues const & huffmanValues()
+{
+    static const GzipValues values;
+    return values;
+}
+
+// ----------------------------------------------------------------------------
+// Function buildHuffman()
+// ----------------------------------------------------------------------------
+
+// Build the code of the code lengths given, symbols having the entries of
+// values, in a table of tableBits bits at most.  Returns 0 for a complete
+// code, 1 for an incomplete one and -1 for an oversubscribed one.
+inline int buildHuffman(GzipHuffman & me, unsigned char const * lengths,
+unsigned count, uint32_t const * values, unsigned tableBits)
+{
+    unsigned counts[16] = {0};
+    for (unsigned symbol = 0; symbol < count; ++symbol)
+        ++counts[lengths[symbol]];
+    counts[0] = 0;
+
+    me.bits = 0;
+    int left = 1;
+    unsigned next[16] = {0};
+    for (unsigned len = 1; len < 16; ++len)
+    {
+        left = (left << 1) - counts[len];
+        if (left < 0)
+            return -1;
+        if (counts[len] != 0)
+            me.bits = len;
+        next[len] = (next[len - 1] + counts[len - 1]) << 1;
+    }
+
+    // Longer codes go on in subtables of subBits bits, one for each of the
+    // first tableBits bits of their codes.
+    me.tableBits = std::min(me.bits, tableBits);
+    unsigned const size = 1u << me.tableBits;
+    unsigned const subBits = me.bits - me.tableBits;
+    resize(me.table, size, Exact());
+    std::fill(begin(me.table, Standard()), end(me.table, Standard()),
+        uint32_t(GzipInvalid));
+    for (unsigned symbol = 0; symbol < count; ++symbol)
+    {
+        unsigned len = lengths[symbol];
+        if (len == 0)
+            continue;
+        unsigned code = next[len]++;
+        unsigned reversed = 0;
+        for (unsigned i = 0; i < len; ++i, code >>= 1)
+            reversed = (reversed << 1) | (code & 1);
+        uint32_t entry = values[symbol] | len;
+        if (len <= me.tableBits)
+        {
+            for (; reversed < size; reversed += 1u << len)
+                me.table[reversed] = entry;
+            continue;
+        }
+
+        unsigned first = reversed & (size - 1);
+        if (!(me.table[first] & GzipSubtable))
+        {
+            me.table[first] = GzipSubtable | uint32_t(length(me.table)) << 16 |
+                subBits << 5 | me.tableBits;
+            resize(me.table, length(me.table) + (1u << subBits),
+                uint32_t(GzipInvalid));
+        }
+        uint32_t * subtable = begin(me.table, Standard()) +
+            (me.table[first] >> 16);
+        for (reversed >>= me.tableBits; reversed < (1u << subBits);
+            reversed += 1u << (len - me.tableBits))
+            subtable[reversed] = entry;
+    }
+    return left > 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function pairLiterals()
+// ----------------------------------------------------------------------------
+
+// Let the entries of a literal, followed by another one whose code is in the
+// rest of the table bits, decode both literals at once.
+inline void pairLiterals(GzipHuffman & me)
+{
+    uint32_t const kinds = GzipLength | GzipEnd | GzipSubtable | GzipInvalid;
+    uint32_t * table = begin(me.table, Standard());
+
+    // Entry index >> len is before index, so it is not paired yet.
+    for (unsigned index = 1u << me.tableBits; index-- > 0;)
+    {
+        uint32_t first = table[index];
+        unsigned len = first & 31;
+        if ((first & kinds) || len >= me.tableBits)
+            continue;
+        uint32_t second = table[index >> len];
+        if ((second & kinds) || len + (second & 31) > me.tableBits)
+            continue;
+        table[index] = (first & ~uint32_t(31)) | GzipPair |
+            (second >> 16) << 24 | (len + (second & 31));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function readSymbol()
+// ----------------------------------------------------------------------------
+
+inline bool readSymbol(unsigned & symbol, GzipBits & bits,
+GzipHuffman const & code)
+{
+    uint32_t entry = code.table[peekBits(bits) & ((1u << code.tableBits) - 1)];
+    if (entry & GzipInvalid)
+        return false;
+    bits.pos += entry & 31;
+    symbol = entry >> 16;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function fixedHuffman()
+// ----------------------------------------------------------------------------
+
+// The codes of the blocks compressed with fixed codes.
+inline GzipHuffman const & fixedHuffman(bool isDistance)
+{
+    struct Fixed
+    {
+        GzipHuffman lit;
+        GzipHuffman dist;
+
+        Fixed()
+        {
+            unsigned char lengths[288];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            buildHuffman(lit, lengths, 288, huffmanValues().lit, 11);
+            pairLiterals(lit);
+            std::fill(lengths, lengths + 30, 5);
+            buildHuffman(dist, lengths, 30, huffmanValues().dist, 8);
+        }
+    };
+    static const Fixed fixed;
+    return isDistance ? fixed.dist : fixed.lit;
+}
+
+// ----------------------------------------------------------------------------
+// Function readDynamicCodes()
+// ----------------------------------------------------------------------------
+
+// Read the codes of a block compressed with dynamic codes.  Incomplete codes
+// are accepted as zlib does, unless isStrict.
+inline bool readDynamicCodes(GzipHuffman & lit, GzipHuffman & dist,
+GzipHuffman & lens, GzipBits & bits, bool isStrict)
+{
+    static const unsigned char order[19] =
+        {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    unsigned lits = readBits(bits, 5) + 257;
+    unsigned dists = readBits(bits, 5) + 1;
+    unsigned lensCount = readBits(bits, 4) + 4;
+    if (lits > 286 || dists > 30)
+        return false;
+
+    unsigned char lengths[320] = {0};
+    for (unsigned i = 0; i < lensCount; ++i)
+        lengths[order[i]] = readBits(bits, 3);
+    if (buildHuffman(lens, lengths, 19, huffmanValues().lens, 7) != 0)
+        return false;
+
+    std::fill(lengths, lengths + 19, 0);
+    for (unsigned i = 0; i < lits + dists;)
+    {
+        unsigned symbol;
+        if (!readSymbol(symbol, bits, lens))
+            return false;
+        if (symbol < 16)
+        {
+            lengths[i++] = symbol;
+            continue;
+        }
+        unsigned value = 0;
+        unsigned repeat;
+        if (symbol == 16)
+        {
+            if (i == 0)
+                return false;
+            value = lengths[i - 1];
+            repeat = 3 + readBits(bits, 2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + readBits(bits, 3);
+        }
+        else
+        {
+            repeat = 11 + readBits(bits, 7);
+        }
+        if (i + repeat > lits + dists)
+            return false;
+        std::fill(lengths + i, lengths + i + repeat, value);
+        i += repeat;
+    }
+    if (lengths[256] == 0)
+        return false;
+
+    int status = buildHuffman(lit, lengths, lits, huffmanValues().lit, 11);
+    if (status < 0 || (status > 0 && (isStrict || lit.bits > 1)))
+        return false;
+    pairLiterals(lit);
+    status = buildHuffman(dist, lengths + lits, dists, huffmanValues().dist,
+        10);
+    return status == 0 || (status > 0 && dist.bits <= 1);
+}
+
+// ----------------------------------------------------------------------------
+// Function isTextByte()
+// ----------------------------------------------------------------------------
+
+inline bool isTextByte(unsigned c)
+{
+    return (c >= 0x20 && c < 0x7f) || c == '\n' || c == '\r' || c == '\t';
+}
+
+// ----------------------------------------------------------------------------
+// Function reserveOut()
+// ----------------------------------------------------------------------------
+
+// Room for count values after outLength, and for the words written past the
+// end of a copy.
+template <typename TValue>
+inline TValue * reserveOut(String<TValue> & out, std::size_t outLength,
+std::size_t count)
+{
+    if (outLength + count + 16 > length(out))
+        resize(out, std::max(2 * length(out), outLength + count + 16));
+    return begin(out, Standard());
+}
+
+// ----------------------------------------------------------------------------
+// Function copyMatch()
+// ----------------------------------------------------------------------------
+
+// Copy count values from distance back, by words of 8 bytes when the source
+// does not overlap them, the first two without a test as most matches are
+// short.  Up to 16 bytes are written past the end.
+template <typename TValue>
+inline void copyMatch(TValue * to, std::size_t distance, unsigned count)
+{
+    TValue const * from = to - distance;
+    if (distance * sizeof(TValue) >= 8)
+    {
+        std::memcpy(to, from, 8);
+        std::memcpy(to + 8 / sizeof(TValue), from + 8 / sizeof(TValue), 8);
+        for (unsigned i = 16 / sizeof(TValue); i < count;
+            i += 8 / sizeof(TValue))
+            std::memcpy(to + i, from + i, 8);
+    }
+    else if (distance == 1)
+    {
+        std::fill(to, to + count, *from);
+    }
+    else
+    {
+        for (unsigned i = 0; i < count; ++i)
+            to[i] = from[i];
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function inflateBlock()
+// ----------------------------------------------------------------------------
+
+// Decode the symbols of a compressed block up to its end.  When isText, the
+// literals must be text bytes.
+template <typename TValue>
+inline bool inflateBlock(String<TValue> & out, std::size_t & outLength,
+GzipBits & bits, GzipHuffman const & lit, GzipHuffman const & dist,
+bool isText)
+{
+    uint32_t const kinds = GzipLength | GzipEnd | GzipSubtable | GzipInvalid;
+    std::size_t const endBits = bits.size * 8;
+    uint32_t const * litTable = begin(lit.table, Standard());
+    uint32_t const * distTable = begin(dist.table, Standard());
+    uint64_t const litMask = (uint64_t(1) << lit.tableBits) - 1;
+    uint64_t const distMask = (uint64_t(1) << dist.tableBits) - 1;
+    TValue * target = reserveOut(out, outLength, 1 << 16);
+    TValue * it = target + outLength;
+    TValue * itEnd = target + length(out) - 258 - 16;
+
+    // The next left bits of the stream are kept in buffer, refilled to 56
+    // bits at least before each symbol: a length and its distance take 48
+    // bits at most.  Zeros are read past the end, then the block fails.
+    unsigned char const * in = bits.data + (bits.pos >> 3);
+    unsigned char const * const inEnd = bits.data + bits.size;
+    uint64_t buffer = 0;
+    unsigned left = 0;
+    auto refill = [&]()
+    {
+        if (inEnd - in >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, in, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            buffer |= word << left;
+            in += (63 - left) >> 3;
+            left |= 56;
+            return true;
+        }
+        for (; left <= 56; left += 8, ++in)
+            buffer |= uint64_t(in < inEnd ? *in : 0) << left;
+        return std::size_t(in - bits.data) * 8 - left <= endBits;
+    };
+    auto skip = [&](unsigned count)
+    {
+        buffer >>= count;
+        left -= count;
+    };
+    auto readEntry = [&](uint32_t const * table, unsigned tableBits,
+        uint64_t mask)
+    {
+        uint32_t entry = table[buffer & mask];
+        if (entry & GzipSubtable)
+            entry = table[(entry >> 16) + ((buffer >> tableBits) &
+                ((1u << ((entry >> 5) & 15)) - 1))];
+        return entry;
+    };
+    refill();
+    skip(bits.pos & 7);
+
+    // The entry of the next symbol is read before the match is copied.
+    uint32_t entry = readEntry(litTable, lit.tableBits, litMask);
+    while (true)
+    {
+        if (it > itEnd)
+        {
+            outLength = it - target;
+            target = reserveOut(out, outLength, 1 << 16);
+            it = target + outLength;
+            itEnd = target + length(out) - 258 - 16;
+        }
+
+        // One or two literals.
+        if (!(entry & kinds))
+        {
+            skip(entry & 31);
+            if (isText && !isTextByte((entry >> 16) & 0xff))
+                return false;
+            *it++ = (entry >> 16) & 0xff;
+            if (entry & GzipPair)
+            {
+                if (isText && !isTextByte(entry >> 24))
+                    return false;
+                *it++ = entry >> 24;
+            }
+            if (!refill())
+                return false;
+            entry = readEntry(litTable, lit.tableBits, litMask);
+            continue;
+        }
+
+        if (entry & GzipEnd)
+        {
+            skip(entry & 31);
+            bits.pos = std::size_t(in - bits.data) * 8 - left;
+            outLength = it - target;
+            return bits.pos <= endBits;
+        }
+        if (entry & GzipInvalid)
+            return false;
+
+        // A length, then its distance.
+        unsigned used = entry & 31;
+        unsigned extra = (entry >> 5) & 15;
+        unsigned count = (entry >> 16) +
+            ((buffer >> used) & ((1u << extra) - 1));
+        skip(used + extra);
+
+        entry = readEntry(distTable, dist.tableBits, distMask);
+        if (entry & GzipInvalid)
+            return false;
+        used = entry & 31;
+        extra = (entry >> 5) & 15;
+        std::size_t distance = (entry >> 16) +
+            ((buffer >> used) & ((1u << extra) - 1));
+        skip(used + extra);
+        if (!refill())
+            return false;
+        entry = readEntry(litTable, lit.tableBits, litMask);
+
+        // The window before the chunk is always there, markers or bytes.
+        copyMatch(it, distance, count);
+        it += count;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function inflateStored()
+// ----------------------------------------------------------------------------
+
+template <typename TValue>
+inline bool inflateStored(String<TValue> & out, std::size_t & outLength,
+GzipBits & bits)
+{
+    std::size_t at = (bits.pos + 7) >> 3;
+    if (at + 4 > bits.size)
+        return false;
+    unsigned count = bits.data[at] | bits.data[at + 1] << 8;
+    unsigned check = bits.data[at + 2] | bits.data[at + 3] << 8;
+    at += 4;
+    if ((count ^ 0xffff) != check || at + count > bits.size)
+        return false;
+
+    TValue * target = reserveOut(out, outLength, count) + outLength;
+    std::copy(bits.data + at, bits.data + at + count, target);
+    outLength += count;
+    bits.pos = (at + count) * 8;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function readGzipHeader()
+// ----------------------------------------------------------------------------
+
+// Skip the header of a member at the byte of bits.
+inline bool readGzipHeader(GzipBits & bits)
+{
+    unsigned char const * data = bits.data;
+    std::size_t at = bits.pos >> 3;
+    if (at + 10 > bits.size || data[at] != 0x1f || data[at + 1] != 0x8b ||
+        data[at + 2] != 8 || (data[at + 3] & 0xe0) != 0)
+        return false;
+
+    unsigned flags = data[at + 3];
+    at += 10;
+    if ((flags & 4) && at + 2 <= bits.size)
+        at += 2 + (data[at] | data[at + 1] << 8);
+    for (unsigned flag = 8; flag <= 16; flag <<= 1)
+    {
+        if (!(flags & flag))
+            continue;
+        while (at < bits.size && data[at] != 0)
+            ++at;
+        ++at;
+    }
+    if (flags & 2)
+        at += 2;
+    if (at > bits.size)
+        return false;
+    bits.pos = at * 8;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function bgzfMemberSize()
+// ----------------------------------------------------------------------------
+
+// Size of the BGZF member at the byte at, 0 when there is none.
+inline std::size_t bgzfMemberSize(unsigned char const * data,
+std::size_t size, std::size_t at)
+{
+    if (at + 18 > size || data[at] != 0x1f || data[at + 1] != 0x8b ||
+        data[at + 2] != 8 || !(data[at + 3] & 4))
+        return 0;
+
+    // The BC subfield holds the size of the member minus one.
+    std::size_t extra = at + 12;
+    std::size_t extraEnd = extra + (data[at + 10] | data[at + 11] << 8);
+    while (extra + 4 <= extraEnd && extraEnd <= size)
+    {
+        unsigned len = data[extra + 2] | data[extra + 3] << 8;
+        if (data[extra] == 'B' && data[extra + 1] == 'C' && len == 2 &&
+            extra + 6 <= extraEnd)
+            return (data[extra + 4] | data[extra + 5] << 8) + 1;
+        extra += 4 + len;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function startOut()
+// ----------------------------------------------------------------------------
+
+// Begin the output with the window, or its markers when it is not known.
+inline void startOut(GzipChunk & me)
+{
+    me.outLength = 1 << 15;
+    if (me.isKnown)
+    {
+        reserveOut(me.bytes, 0, 1 << 17);
+        std::copy(begin(me.window, Standard()), end(me.window, Standard()),
+            begin(me.bytes, Standard()));
+        return;
+    }
+    uint16_t * out = reserveOut(me.out, 0, 1 << 17);
+    for (unsigned i = 0; i < (1u << 15); ++i)
+        out[i] = 0x8000 | i;
+}
+
+// ----------------------------------------------------------------------------
+// Function findBlock()
+// ----------------------------------------------------------------------------
+
+// Bit of the first member header, or dynamic block decoding to text, starting
+// in the bytes [from, to), or -1.  Blocks of other types are not looked for,
+// a chunk without a block is left to the chunk before.
+inline std::size_t findBlock(GzipChunk & me, unsigned char const * data,
+std::size_t size, std::size_t from, std::size_t to)
+{
+    GzipBits bits = {data, size, 0};
+    me.isKnown = false;
+    startOut(me);
+    for (std::size_t pos = from * 8; pos < to * 8; ++pos)
+    {
+        bits.pos = pos;
+        if ((pos & 7) == 0 && data[pos >> 3] == 0x1f)
+        {
+            if (readGzipHeader(bits))
+                return pos;
+            continue;
+        }
+
+        // Not last, dynamic codes, at most 286 literals and 30 distances.
+        uint64_t value = peekBits(bits);
+        if ((value & 7) != 4 || ((value >> 3) & 31) > 29 ||
+            ((value >> 8) & 31) > 29)
+            continue;
+
+        // The code of the code lengths must be complete.
+        unsigned lensCount = ((value >> 13) & 15) + 4;
+        bits.pos = pos + 17;
+        value = peekBits(bits);
+        unsigned kraft = 0;
+        for (unsigned i = 0; i < lensCount; ++i, value >>= 3)
+        {
+            if (value & 7)
+                kraft += 128 >> (value & 7);
+        }
+        if (kraft != 128)
+            continue;
+
+        bits.pos = pos + 3;
+        me.outLength = 1 << 15;
+        if (readDynamicCodes(me.lit, me.dist, me.lens, bits, true) &&
+            inflateBlock(me.out, me.outLength, bits, me.lit, me.dist, true))
+            return pos;
+    }
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// Function inflateChunk()
+// ----------------------------------------------------------------------------
+
+// Decode from start to the first block or member header at or after stop, or
+// after maxOut bytes.
+template <typename TValue>
+inline void _inflateChunk(GzipChunk & me, String<TValue> & out,
+unsigned char const * data, std::size_t size, std::size_t maxOut)
+{
+    GzipBits bits = {data, size, me.start};
+    std::size_t const endBits = size * 8;
+    me.isEnd = false;
+    me.isFailed = false;
+    clear(me.ends);
+    startOut(me);
+
+    while (bits.pos < me.stop && me.outLength - (1 << 15) < maxOut)
+    {
+        // A block never starts with 0x1f, its type would be 3.
+        if ((bits.pos & 7) == 0 && bits.pos < endBits &&
+            data[bits.pos >> 3] == 0x1f)
+        {
+            if (!readGzipHeader(bits))
+            {
+                me.isFailed = true;
+                break;
+            }
+            continue;
+        }
+        if (bits.pos + 3 > endBits)
+        {
+            me.isFailed = true;
+            break;
+        }
+
+        unsigned header = readBits(bits, 3);
+        bool isBlock = false;
+        switch (header >> 1)
+        {
+            case 0:
+                isBlock = inflateStored(out, me.outLength, bits);
+                break;
+            case 1:
+                isBlock = inflateBlock(out, me.outLength, bits,
+                    fixedHuffman(false), fixedHuffman(true), false);
+                break;
+            case 2:
+                isBlock = readDynamicCodes(me.lit, me.dist, me.lens, bits,
+                    false) && inflateBlock(out, me.outLength, bits, me.lit,
+                    me.dist, false);
+                break;
+        }
+        if (!isBlock)
+        {
+            me.isFailed = true;
+            break;
+        }
+        if (!(header & 1))
+            continue;
+
+        // Trailer of the member, then another member or the end.
+        std::size_t at = (bits.pos + 7) >> 3;
+        if (at + 8 > size)
+        {
+            me.isFailed = true;
+            break;
+        }
+        GzipMemberEnd memberEnd;
+        memberEnd.offset = me.outLength - (1 << 15);
+        memberEnd.crc = 0;
+        memberEnd.isize = 0;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            memberEnd.crc |= uint32_t(data[at + i]) << (8 * i);
+            memberEnd.isize |= uint32_t(data[at + 4 + i]) << (8 * i);
+        }
+        appendValue(me.ends, memberEnd);
+        bits.pos = (at + 8) * 8;
+        if (at + 8 == size || data[at + 8] != 0x1f)
+        {
+            me.isEnd = true;
+            break;
+        }
+    }
+    me.end = bits.pos;
+}
+
+inline void inflateChunk(GzipChunk & me, unsigned char const * data,
+std::size_t size, std::size_t maxOut)
+{
+    if (me.isKnown)
+        _inflateChunk(me, me.bytes, data, size, maxOut);
+    else
+        _inflateChunk(me, me.out, data, size, maxOut);
+}
+
+// ----------------------------------------------------------------------------
+// Function resolveOut()
+// ----------------------------------------------------------------------------
+
+// Copy the output values [from, to) to bytes, markers read from the window.
+inline void resolveOut(char * target, GzipChunk const & me, std::size_t from,
+std::size_t to)
+{
+    if (me.isKnown)
+    {
+        std::copy(begin(me.bytes, Standard()) + from,
+            begin(me.bytes, Standard()) + to, target);
+        return;
+    }
+    uint16_t const * it = begin(me.out, Standard()) + from;
+    uint16_t const * itEnd = begin(me.out, Standard()) + to;
+    for (; it != itEnd; ++it, ++target)
+        *target = (*it & 0x8000) ? me.window[*it & 0x7fff] : char(*it);
+}
+
+// ----------------------------------------------------------------------------
+// Function isOpen()
+// ----------------------------------------------------------------------------
+
+inline bool isOpen(GzipFileIn const & me)
+{
+    return me.fd != -1;
+}
+
+// ----------------------------------------------------------------------------
+// Function setThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the team decompressing and parsing the next records, the file
+// may be open.
+inline void setThreads(GzipFileIn & me, unsigned threads)
+{
+    me.threads = threads;
+    setThreads(me.text, threads);
+}
+
+// ----------------------------------------------------------------------------
+// Function close()
+// ----------------------------------------------------------------------------
+
+inline void close(GzipFileIn & me)
+{
+    // The index is complete once all the records are read.
+    if (me.isIndexing && me.isEnd && !me.text.isPartial && atEnd(me.text))
+    {
+        me.index.records = me.recordBase + me.text.records;
+        if (!save(me.index, toCString(me.indexFile)))
+            throw IOError("Error while writing index file.");
+    }
+    unmapFile(reinterpret_cast<char const *>(me.data), me.size, me.fd);
+    close(me.text);
+    unsigned threads = me.threads;
+    me = GzipFileIn();
+    me.threads = threads;
+}
+
+// ----------------------------------------------------------------------------
+// Function open()
+// ----------------------------------------------------------------------------
+
+// Open regular files named *.gz or *.bgz and starting as gzip only, the
+// others are left to a SeqFileIn.
+inline bool open(GzipFileIn & me, char const * fileName)
+{
+    close(me);
+    if (!isGzipName(fileName) && !isBgzfName(fileName))
+        return false;
+#if SEQAN_HAS_ZLIB
+    char const * data;
+    if (!mapFile(data, me.size, me.fd, fileName))
+        return false;
+    me.data = reinterpret_cast<unsigned char const *>(data);
+    if (me.size < 2 || me.data[0] != 0x1f || me.data[1] != 0x8b)
+    {
+        close(me);
+        return false;
+    }
+
+    me.isBgzf = bgzfMemberSize(me.data, me.size, 0) != 0;
+    me.index.size = me.size;
+    me.index.trailer = 0;
+    for (unsigned i = 0; i < 8 && i < me.size; ++i)
+        me.index.trailer |= uint64_t(me.data[me.size - 1 - i]) << (8 * i);
+    me.isEnd = false;
+    resize(me.window, 1 << 15, '\0');
+    me.text.threads = me.threads;
+    me.text.isPartial = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+template <typename TSpec>
+inline bool open(Pair<GzipFileIn, TSpec> & me,
+        const char * fileName1,
+        const char * fileName2)
+{
+    if (open(me.i1, fileName1) && open(me.i2, fileName2))
+        return true;
+    close(me.i1);
+    close(me.i2);
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Function loadIndex()
+// ----------------------------------------------------------------------------
+
+// Load the index of the file opened, false when it has none.
+inline bool loadIndex(GzipFileIn & me, char const * indexFile)
+{
+    uint64_t size = me.index.size;
+    uint64_t trailer = me.index.trailer;
+    if (load(me.index, indexFile, size, trailer))
+        return true;
+    me.index = GzipIndex();
+    me.index.size = size;
+    me.index.trailer = trailer;
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Function buildIndex()
+// ----------------------------------------------------------------------------
+
+// Index the file opened while it is read from its start, a checkpoint every
+// span decompressed bytes.  Checkpoints being at the start of chunks, chunks
+// are cut to a third of a span of output at most, FASTQ compressing less than
+// three times, so that small spans are kept.
+inline void buildIndex(GzipFileIn & me, char const * indexFile, uint64_t span)
+{
+    SEQAN_ASSERT_EQ(me.outSize, 0u);
+    me.chunkSize = std::min<uint64_t>(me.chunkSize,
+        std::max<uint64_t>(span / 9, 1 << 16));
+    clear(me.index.checkpoints);
+    me.index.span = span;
+    me.indexFile = indexFile;
+    me.isIndexing = true;
+}
+
+// ----------------------------------------------------------------------------
+// Function addCheckpoints()
+// ----------------------------------------------------------------------------
+
+// Add the checkpoints of a round at the start of its chunks, every span bytes,
+// its output following left bytes of text from the record at the text pos.
+// The round started at member, with isBgzf.  Records are parsed up to the
+// first one starting in the output of the chunk, the checkpoints of a round
+// too short to hold it are not added.
+inline void addCheckpoints(GzipFileIn & me, std::size_t member, bool isBgzf,
+int chunks, std::size_t left)
+{
+    char const * first = toCString(me.buffer);
+    char const * end = first + length(me.buffer);
+    char const * it = first;
+    uint64_t records = 0;
+    FastqView view;
+    for (int k = 0; k < chunks; ++k)
+    {
+        GzipChunk const & chunk = me.chunks[k];
+        uint64_t out = me.outSize + chunk.offset - left;
+        if (!empty(me.index.checkpoints) &&
+            out < back(me.index.checkpoints).out + me.index.span)
+            continue;
+
+        try
+        {
+            while (it < first + chunk.offset && readRecord(view, it, end))
+                ++records;
+        }
+        catch (ParseError const &)
+        {
+            return;
+        }
+        if (it < first + chunk.offset || it == end)
+            return;
+
+        // BGZF chunks after the first one start on their member, unless
+        // members were no longer found in the round.
+        GzipCheckpoint checkpoint;
+        checkpoint.bitPos = chunk.start;
+        checkpoint.member = k > 0 && me.isBgzf ? chunk.start >> 3 : member;
+        checkpoint.out = out;
+        checkpoint.crc = chunk.crc;
+        checkpoint.isize = chunk.isize;
+        checkpoint.isBgzf = k > 0 ? me.isBgzf : isBgzf;
+        checkpoint.window = chunk.window;
+        checkpoint.record = me.recordBase + me.text.records + records;
+        checkpoint.skip = it - first - chunk.offset;
+        appendValue(me.index.checkpoints, checkpoint);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function fillText()
+// ----------------------------------------------------------------------------
+
+// Decompress one round and append it to the text left to parse.
+inline void fillText(GzipFileIn & me)
+{
+#if SEQAN_HAS_ZLIB
+    if (me.isEnd)
+    {
+        me.text.isPartial = false;
+        return;
+    }
+
+    // The member at the start of the round, for its checkpoints.
+    std::size_t member = me.member;
+    bool isBgzf = me.isBgzf;
+
+    // Chunks start at the first block found in their bytes.
+    std::size_t first = me.bitPos >> 3;
+    int chunks = 1;
+    while (chunks < static_cast<int>(me.threads) &&
+        first + chunks * me.chunkSize < me.size)
+        ++chunks;
+    std::size_t last = (first + chunks * me.chunkSize) * 8;
+    resize(me.chunks, chunks);
+    me.chunks[0].start = me.bitPos;
+    me.chunks[0].window = me.window;
+    me.chunks[0].isKnown = true;
+
+    for (int k = 1; k < chunks && me.isBgzf; ++k)
+    {
+        std::size_t from = first + k * me.chunkSize;
+        std::size_t to = std::min(me.size, from + me.chunkSize);
+        while (me.isBgzf && me.member < from)
+        {
+            std::size_t memberSize = bgzfMemberSize(me.data, me.size,
+                me.member);
+            me.member += memberSize;
+            me.isBgzf = memberSize != 0;
+        }
+        me.chunks[k].start = me.member < to ? me.member * 8 : -1;
+    }
+
+    // Without member sizes, chunks start at the first block found.
+    if (!me.isBgzf)
+    {
+        SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+        for (int k = 1; k < chunks; ++k)
+        {
+            std::size_t from = first + k * me.chunkSize;
+            me.chunks[k].start = findBlock(me.chunks[k], me.data, me.size,
+                from, std::min(me.size, from + me.chunkSize));
+        }
+    }
+    int count = 1;
+    for (int k = 1; k < chunks; ++k)
+    {
+        if (me.chunks[k].start != std::size_t(-1))
+            me.chunks[count++].start = me.chunks[k].start;
+    }
+    chunks = count;
+    for (int k = 0; k < chunks; ++k)
+        me.chunks[k].stop = k + 1 < chunks ? me.chunks[k + 1].start : last;
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int k = 0; k < chunks; ++k)
+        inflateChunk(me.chunks[k], me.data, me.size, me.chunkSize * 16);
+
+    // The first chunk starts on a block, the others are kept while they start
+    // where the one before ended.
+    if (me.chunks[0].isFailed)
+        throw IOError("Error while decompressing reads file.");
+    count = 1;
+    while (count < chunks && !me.chunks[count - 1].isEnd &&
+        me.chunks[count - 1].end == me.chunks[count].start &&
+        !me.chunks[count].isFailed)
+        ++count;
+    chunks = count;
+
+    // Windows from one chunk to the next, then the text.
+    erase(me.buffer, 0, me.text.pos);
+    std::size_t offset = length(me.buffer);
+    std::size_t left = offset;
+    for (int k = 0; k < chunks; ++k)
+    {
+        GzipChunk & chunk = me.chunks[k];
+        CharString & next = k + 1 < chunks ? me.chunks[k + 1].window :
+            me.window;
+        resize(next, 1 << 15);
+        resolveOut(&next[0], chunk, chunk.outLength - (1 << 15),
+            chunk.outLength);
+        chunk.offset = offset;
+        offset += chunk.outLength - (1 << 15);
+    }
+    resize(me.buffer, offset);
+
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int k = 0; k < chunks; ++k)
+    {
+        GzipChunk & chunk = me.chunks[k];
+        std::size_t size = chunk.outLength - (1 << 15);
+        if (size > 0)
+            resolveOut(&me.buffer[chunk.offset], chunk, 1 << 15,
+                chunk.outLength);
+
+        resize(chunk.crcs, length(chunk.ends) + 1);
+        std::size_t from = 0;
+        for (unsigned i = 0; i <= length(chunk.ends); ++i)
+        {
+            std::size_t to = i < length(chunk.ends) ? chunk.ends[i].offset :
+                size;
+            chunk.crcs[i] = gzipCrc(0,
+                toCString(me.buffer) + chunk.offset + from, to - from);
+            from = to;
+        }
+    }
+
+    // Members checked against their trailer.
+    for (int k = 0; k < chunks; ++k)
+    {
+        GzipChunk & chunk = me.chunks[k];
+        chunk.crc = me.crc;
+        chunk.isize = me.isize;
+        std::size_t from = 0;
+        for (unsigned i = 0; i <= length(chunk.ends); ++i)
+        {
+            std::size_t to = i < length(chunk.ends) ? chunk.ends[i].offset :
+                chunk.outLength - (1 << 15);
+            me.crc = crc32_combine(me.crc, chunk.crcs[i], to - from);
+            me.isize += to - from;
+            from = to;
+            if (i == length(chunk.ends))
+                break;
+            if (me.crc != chunk.ends[i].crc || me.isize != chunk.ends[i].isize)
+                throw IOError("Error while decompressing reads file.");
+            me.crc = 0;
+            me.isize = 0;
+        }
+    }
+
+    if (me.isIndexing)
+        addCheckpoints(me, member, isBgzf, chunks, left);
+    me.outSize += offset - left;
+    me.bitPos = me.chunks[chunks - 1].end;
+    me.isEnd = me.chunks[chunks - 1].isEnd;
+    me.text.data = empty(me.buffer) ? NULL : toCString(me.buffer);
+    me.text.size = length(me.buffer);
+    me.text.pos = 0;
+    me.text.isPartial = !me.isEnd;
+#else
+    ignoreUnusedVariableWarning(me);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function readRecords()
+// ----------------------------------------------------------------------------
+
+// Read maxRecords records at most into the arenas, decompressing rounds
+// while the text left is short of a round.
+template <typename TNames, typename TSeqs, typename TSize>
+inline void
+readRecords(TNames & names, TSeqs & seqs, GzipFileIn & me, TSize maxRecords)
+{
+    TSize count = 0;
+    while (count < maxRecords)
+    {
+        if (me.text.isPartial &&
+            me.text.size - me.text.pos < (std::size_t(me.threads) << 20))
+            fillText(me);
+
+        std::size_t before = length(names);
+        readRecords(names, seqs, me.text, maxRecords - count);
+        count += length(names) - before;
+        if (!me.text.isPartial)
+            break;
+        if (length(names) == before)
+            fillText(me);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function skipRecords()
+// ----------------------------------------------------------------------------
+
+// Parse count records at most without keeping them, returns their number.
+template <typename TSize>
+inline TSize skipRecords(GzipFileIn & me, TSize count)
+{
+    TSize skipped = 0;
+    FastqView view;
+    while (skipped < count)
+    {
+        if (me.text.isPartial &&
+            me.text.size - me.text.pos < (std::size_t(me.threads) << 20))
+            fillText(me);
+
+        if (readRecord(view, me.text))
+            ++skipped;
+        else if (!me.text.isPartial)
+            break;
+        else
+            fillText(me);
+    }
+    return skipped;
+}
+
+// ----------------------------------------------------------------------------
+// Function seekRecord()
+// ----------------------------------------------------------------------------
+
+// Restart the decompression at the last checkpoint before the record, then
+// skip the records up to it.  Returns false without an index.
+inline bool seekRecord(GzipFileIn & me, uint64_t record)
+{
+    if (me.isIndexing || empty(me.index.checkpoints))
+        return false;
+
+    GzipCheckpoint const & checkpoint = findCheckpoint(me.index, record);
+    me.bitPos = checkpoint.bitPos;
+    me.member = checkpoint.member;
+    me.isBgzf = checkpoint.isBgzf;
+    me.isEnd = false;
+    me.window = checkpoint.window;
+    me.crc = checkpoint.crc;
+    me.isize = checkpoint.isize;
+    me.outSize = checkpoint.out;
+    clear(me.buffer);
+    me.text.data = NULL;
+    me.text.size = 0;
+    me.text.pos = 0;
+    me.text.records = 0;
+    me.text.recordBytes = 0;
+    me.text.isPartial = true;
+
+    fillText(me);
+    me.text.pos = std::min<std::size_t>(checkpoint.skip, me.text.size);
+    me.recordBase = checkpoint.record;
+    skipRecords(me, record - checkpoint.record);
+    return true;
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_GZIP_IN_H_
@@ -0,0 +1,255 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Random access index of gzip files
+// ============================================================================
+#ifndef APP_HMNTRIMMER_GZIP_INDEX_H_
+#define APP_HMNTRIMMER_GZIP_INDEX_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+using namespace seqan;
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class GzipCheckpoint
+// ----------------------------------------------------------------------------
+
+// The state of the inflate at bitPos, a block or member start where out
+// bytes are decompressed: the window before it, the next BGZF member and the
+// CRC and size of the member so far.  The first record at or after out is
+// the number record, skip bytes further.
+struct GzipCheckpoint
+{
+    uint64_t        bitPos;
+    uint64_t        member;
+    uint64_t        out;
+    uint64_t        record;
+    uint32_t        skip;
+    uint32_t        crc;
+    uint32_t        isize;
+    uint32_t        isBgzf;
+    CharString      window;
+
+    GzipCheckpoint() :
+        bitPos(0),
+        member(0),
+        out(0),
+        record(0),
+        skip(0),
+        crc(0),
+        isize(0),
+        isBgzf(0),
+        window()
+    {};
+};
+
+// ----------------------------------------------------------------------------
+// Class GzipIndex
+// ----------------------------------------------------------------------------
+
+// Checkpoints every span decompressed bytes of a gzip file of size bytes
+// ending with trailer, holding records records.  Saved next to the file as
+// FILE.hmi.
+struct GzipIndex
+{
+    String<GzipCheckpoint>  checkpoints;
+    uint64_t                span;
+    uint64_t                size;
+    uint64_t                trailer;
+    uint64_t                records;
+
+    GzipIndex() :
+        checkpoints(),
+        span(32 << 20),
+        size(0),
+        trailer(0),
+        records(0)
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function indexFileName()
+// ----------------------------------------------------------------------------
+
+inline CharString indexFileName(char const * fileName)
+{
+    CharString name = fileName;
+    append(name, ".hmi");
+    return name;
+}
+
+// ----------------------------------------------------------------------------
+// Function findCheckpoint()
+// ----------------------------------------------------------------------------
+
+// Last checkpoint before the record, the first one when there is none.
+inline GzipCheckpoint const &
+findCheckpoint(GzipIndex const & me, uint64_t record)
+{
+    SEQAN_ASSERT_NOT(empty(me.checkpoints));
+    auto it = std::upper_bound(begin(me.checkpoints, Standard()),
+        end(me.checkpoints, Standard()), record,
+        [](uint64_t value, GzipCheckpoint const & checkpoint)
+        {
+            return value < checkpoint.record;
+        });
+    if (it != begin(me.checkpoints, Standard()))
+        --it;
+    return *it;
+}
+
+// ----------------------------------------------------------------------------
+// Function save()
+// ----------------------------------------------------------------------------
+
+// Fixed size little endian fields, after the magic "HMNGZI" and version 1.
+template <typename TValue>
+inline void _writeIndexValue(std::ofstream & file, TValue value)
+{
+    char bytes[sizeof(TValue)];
+    for (unsigned i = 0; i < sizeof(TValue); ++i, value >>= 8)
+        bytes[i] = char(value & 0xff);
+    file.write(bytes, sizeof(TValue));
+}
+
+// The index is written aside then renamed, so that processes indexing the
+// same file at the same time never read a partial one.  The file aside is
+// made by mkstemp(), unique even to processes of other hosts sharing it.
+inline bool save(GzipIndex const & me, char const * fileName)
+{
+    std::string tmpName = fileName;
+#ifdef __linux__
+    tmpName += ".XXXXXX";
+    int fd = ::mkstemp(&tmpName[0]);
+    if (fd == -1)
+        return false;
+    ::fchmod(fd, 0644);
+    ::close(fd);
+#else
+    tmpName += ".tmp";
+#endif
+    std::ofstream file(tmpName, std::ios::binary | std::ios::trunc);
+    file.write("HMNGZI\1\0", 8);
+    _writeIndexValue(file, me.span);
+    _writeIndexValue(file, me.size);
+    _writeIndexValue(file, me.trailer);
+    _writeIndexValue(file, me.records);
+    _writeIndexValue(file, uint64_t(length(me.checkpoints)));
+    for (GzipCheckpoint const & checkpoint : me.checkpoints)
+    {
+        _writeIndexValue(file, checkpoint.bitPos);
+        _writeIndexValue(file, checkpoint.member);
+        _writeIndexValue(file, checkpoint.out);
+        _writeIndexValue(file, checkpoint.record);
+        _writeIndexValue(file, checkpoint.skip);
+        _writeIndexValue(file, checkpoint.crc);
+        _writeIndexValue(file, checkpoint.isize);
+        _writeIndexValue(file, checkpoint.isBgzf);
+        file.write(toCString(checkpoint.window), 1 << 15);
+    }
+    file.close();
+    if (!file.good() || std::rename(tmpName.c_str(), fileName) != 0)
+    {
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function load()
+// ----------------------------------------------------------------------------
+
+template <typename TValue>
+inline void _readIndexValue(std::ifstream & file, TValue & value)
+{
+    unsigned char bytes[sizeof(TValue)] = {};
+    file.read(reinterpret_cast<char *>(bytes), sizeof(TValue));
+    value = 0;
+    for (unsigned i = sizeof(TValue); i > 0; --i)
+        value = (value << 8) | bytes[i - 1];
+}
+
+// Load the index of a gzip file of size bytes ending with trailer.  Returns
+// false when there is none, or when it was made for another file.
+inline bool load(GzipIndex & me, char const * fileName, uint64_t size,
+uint64_t trailer)
+{
+    me = GzipIndex();
+    std::ifstream file(fileName, std::ios::binary);
+    char magic[8] = {};
+    file.read(magic, 8);
+    if (!file.good() || std::memcmp(magic, "HMNGZI\1\0", 8) != 0)
+        return false;
+
+    uint64_t count = 0;
+    _readIndexValue(file, me.span);
+    _readIndexValue(file, me.size);
+    _readIndexValue(file, me.trailer);
+    _readIndexValue(file, me.records);
+    _readIndexValue(file, count);
+    if (!file.good() || me.size != size || me.trailer != trailer ||
+        count == 0 || count > size)
+        return false;
+
+    resize(me.checkpoints, count);
+    for (GzipCheckpoint & checkpoint : me.checkpoints)
+    {
+        _readIndexValue(file, checkpoint.bitPos);
+        _readIndexValue(file, checkpoint.member);
+        _readIndexValue(file, checkpoint.out);
+        _readIndexValue(file, checkpoint.record);
+        _readIndexValue(file, checkpoint.skip);
+        _readIndexValue(file, checkpoint.crc);
+        _readIndexValue(file, checkpoint.isize);
+        _readIndexValue(file, checkpoint.isBgzf);
+        resize(checkpoint.window, 1 << 15);
+        file.read(&checkpoint.window[0], 1 << 15);
+    }
+    if (!file.good())
+    {
+        clear(me.checkpoints);
+        return false;
+    }
+    return true;
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_GZIP_INDEX_H_
@@ -17,6 +17,7 @@
 // STL headers
 // ----------------------------------------------------------------------------
 
+#include <limits>
 #include <type_traits>
 #include <random>
 
@@ -114,21 +115,93 @@ setupArgumentParser(ArgumentParser & parser, Options const & options)
     setValidValues(parser, "output-report", Options::getReportExt());
 
     addOption(parser, ArgParseOption("t", "threads", "Specify the number of\
-    threads to use.", ArgParseOption::INTEGER));
-    setMinValue(parser, "threads", "1");
-#ifdef _OPENMP
-    setMaxValue(parser, "threads", "8");
-#else
-    setMaxValue(parser, "threads", "1");
-#endif
+    threads to use, or auto to use the CPUs allowed by the affinity mask and \
+    the cgroup quota.", ArgParseOption::STRING));
     setDefaultValue(parser, "threads", options.threadsCount);
 
+    addOption(parser, ArgParseOption("pt", "pin-threads", "Pin trimming \
+    threads to CPUs, filling one NUMA node after the other."));
+
     addOption(parser, ArgParseOption("rb", "reads-batch", "Specify the \
     number of reads to process in one batch.", ArgParseOption::INTEGER));
     setMinValue(parser, "reads-batch", "100");
     setMaxValue(parser, "reads-batch", "50000000");
     setDefaultValue(parser, "reads-batch", options.readsBatch);
 
+    addOption(parser, ArgParseOption("bm", "batch-memory", "Specify the \
+    memory of one batch in megabytes, names and sequences of both mates. \
+    Batches are then not limited in number of reads unless reads-batch is \
+    given.", ArgParseOption::INTEGER));
+    setMinValue(parser, "batch-memory", "1");
+    setMaxValue(parser, "batch-memory", "1048576");
+
+    addOption(parser, ArgParseOption("bb", "batch-buffers", "Specify the \
+    number of batches in memory at the same time, with several threads \
+    reading, trimming and writing are overlapped.", ArgParseOption::INTEGER));
+    setMinValue(parser, "batch-buffers", "2");
+    setMaxValue(parser, "batch-buffers", "16");
+    setDefaultValue(parser, "batch-buffers", options.batchBuffers);
+
+    addOption(parser, ArgParseOption("zl", "zstd-level", "Specify the \
+    compression level of zstd output files.", ArgParseOption::INTEGER));
+    setMinValue(parser, "zstd-level", "1");
+    setMaxValue(parser, "zstd-level", "19");
+    setDefaultValue(parser, "zstd-level", options.zstdLevel);
+
+    addOption(parser, ArgParseOption("si", "simd", "Specify the instruction \
+    set of the trimming kernels, auto for the best one of the CPU.",
+    ArgParseOption::STRING));
+    setValidValues(parser, "simd", "auto scalar sse2 avx2 avx512");
+    setDefaultValue(parser, "simd", "auto");
+
+    addOption(parser, ArgParseOption("gi", "gzip-index", "Use the random \
+    access index FILE.hmi of gzip input files, or build it while reading them \
+    when it is missing."));
+
+    addOption(parser, ArgParseOption("gio", "gzip-index-only", "Only build \
+    the index FILE.hmi of gzip input files, output files are not needed."));
+
+    addOption(parser, ArgParseOption("gis", "gzip-index-span", "Specify the \
+    megabytes of reads between two checkpoints of the gzip index.",
+    ArgParseOption::INTEGER));
+    setMinValue(parser, "gzip-index-span", "1");
+    setMaxValue(parser, "gzip-index-span", "65536");
+    setDefaultValue(parser, "gzip-index-span", options.gzipIndexSpan >> 20);
+
+    addOption(parser, ArgParseOption("rs", "record-start", "Specify the \
+    number of the first read, or pair of reads, to trim.  Gzip input files \
+    start from their index when there is one, the reads before are skipped.",
+    ArgParseOption::INT64));
+    setMinValue(parser, "record-start", "0");
+    setDefaultValue(parser, "record-start", options.recordStart);
+
+    addOption(parser, ArgParseOption("sh", "shard", "Trim shard i of N of \
+    the reads only, as i/N.  Plain files are cut in parts of bytes, gzip \
+    files in parts of reads from their index.", ArgParseOption::STRING));
+
+    addOption(parser, ArgParseOption("rm", "report-merge", "Only merge the \
+    reports of all the shards of a run into the output report, input and \
+    output files are not needed.", ArgParseOption::INPUT_FILE, "FILE", true));
+    setValidValues(parser, "report-merge", Options::getReportExt());
+
+    addOption(parser, ArgParseOption("wd", "work-dir", "Share the run with \
+    the other processes started on this directory: they claim chunks of the \
+    reads one by one and write the outputs and report of each chunk there.",
+    ArgParseOption::OUTPUT_DIRECTORY));
+
+    addOption(parser, ArgParseOption("wc", "work-chunks", "Specify the \
+    number of chunks of the reads in the work directory.",
+    ArgParseOption::INTEGER));
+    setMinValue(parser, "work-chunks", "1");
+    setMaxValue(parser, "work-chunks", "65536");
+    setDefaultValue(parser, "work-chunks", options.workChunks);
+
+    addOption(parser, ArgParseOption("wt", "work-timeout", "Specify the \
+    seconds after which the chunk of a process which stopped is claimed \
+    again.", ArgParseOption::INTEGER));
+    setMinValue(parser, "work-timeout", "10");
+    setDefaultValue(parser, "work-timeout", options.workTimeout);
+
     addOption(parser, ArgParseOption("ver", "verbose", "Specify the log \
     level to use", ArgParseOption::INTEGER));
     setMinValue(parser, "verbose", "1");
@@ -180,6 +253,25 @@ const ** argv)
     if (res != ArgumentParser::PARSE_OK)
         return res;
 
+    // Merge of reports only.
+    unsigned reportMergeCount = getOptionValueCount(parser, "report-merge");
+    if (reportMergeCount > 0)
+    {
+        resize(options.reportMergeFiles, reportMergeCount);
+        for (unsigned i = 0; i < reportMergeCount; ++i)
+            getOptionValue(options.reportMergeFiles[i], parser,
+                "report-merge", i);
+        if (!getOptionValue(options.reportFile, parser, "output-report"))
+        {
+            std::cerr << getAppName(parser) << "Reports are merged into \
+            \"output-report\"" << std::endl;
+            return ArgumentParser::PARSE_ERROR;
+        }
+        options.isReportFile = true;
+        getOptionValue(options.logLevel, parser, "verbose");
+        return ArgumentParser::PARSE_OK;
+    }
+
     // Get files input.
     bool isInputFastqForward = isSet(parser, "input-fastq-forward");
     bool isInputFastqReverse = isSet(parser, "input-fastq-reverse");
@@ -215,6 +307,60 @@ const ** argv)
         return ArgumentParser::PARSE_ERROR;
     }
 
+    // Index of gzip input files only, no output.
+    options.isGzipIndexOnly = isSet(parser, "gzip-index-only");
+    options.isGzipIndex = options.isGzipIndexOnly || isSet(parser,
+        "gzip-index");
+    unsigned gzipIndexSpan(0);
+    if (getOptionValue(gzipIndexSpan, parser, "gzip-index-span"))
+        options.gzipIndexSpan = gzipIndexSpan * 1024ul * 1024ul;
+    getOptionValue(options.recordStart, parser, "record-start");
+
+    // Shard i of N, numbered from 1.
+    CharString shard;
+    if (getOptionValue(shard, parser, "shard"))
+    {
+        String<CharString> sshard;
+        unsigned shardIndex(0);
+        unsigned shardCount(0);
+        strSplit(sshard, shard, EqualsChar<'/'>());
+        if (length(sshard) != 2 or ! lexicalCast(shardIndex, sshard[0]) or !
+            lexicalCast(shardCount, sshard[1]) or shardIndex == 0 or
+            shardIndex > shardCount or options.recordStart > 0)
+        {
+            std::cerr << getAppName(parser) << "Shard must be i/N with 1 <= \
+            i <= N, without \"record-start\"" << std::endl;
+            return ArgumentParser::PARSE_ERROR;
+        }
+        options.shardIndex = shardIndex - 1;
+        options.shardCount = shardCount;
+    }
+
+    // Work directory, cut in chunks.
+    if (getOptionValue(options.workDir, parser, "work-dir") and
+        (options.shardCount > 1 or options.recordStart > 0 or
+        options.isGzipIndexOnly))
+    {
+        std::cerr << getAppName(parser) << "Work directory is cut in chunks \
+        without \"shard\", \"record-start\" or \"gzip-index-only\"" <<
+        std::endl;
+        return ArgumentParser::PARSE_ERROR;
+    }
+
+    // Zstd input is streamed or cut by frames which may split records, it has
+    // no read numbers to cut shards on.
+    if ((options.shardCount > 1 or !empty(options.workDir)) and
+        (isZstdName(toCString(options.inputFile.i1)) or
+        isZstdName(toCString(options.inputFile.i2))))
+    {
+        std::cerr << getAppName(parser) << "Zstd input files are not cut in \
+        shards, use \"shard\" or \"work-dir\" with plain or gzip files" <<
+        std::endl;
+        return ArgumentParser::PARSE_ERROR;
+    }
+    getOptionValue(options.workChunks, parser, "work-chunks");
+    getOptionValue(options.workTimeout, parser, "work-timeout");
+
     // Get files output.
     bool isOutputFastqForward = isSet(parser, "output-fastq-forward");
     bool isOutputFastqReverse = isSet(parser, "output-fastq-reverse");
@@ -238,7 +384,8 @@ const ** argv)
         getOptionValue(options.outputFile.i1, parser, "output-fastq-interleaved");
         options.formatOutput = FileStreamFormat::Interleaved;
     }
-    if (options.formatOutput == FileStreamFormat::Undefined)
+    if (options.formatOutput == FileStreamFormat::Undefined and !
+    options.isGzipIndexOnly)
     {
         std::cerr << getAppName(parser) << "Incompatibles files in output \
         are indicated : either \"output-fastq-forward\", \
@@ -258,7 +405,7 @@ const ** argv)
         (options.formatOutput == FileStreamFormat::Fastq or options.formatOutput
         == FileStreamFormat::Interleaved))
         isWellFormat = true;
-    if (!isWellFormat)
+    if (!isWellFormat and ! options.isGzipIndexOnly)
     {
         std::cerr << getAppName(parser) << "Conflict single/paired formats \
         between input/output files is found" << std::endl;
@@ -274,8 +421,39 @@ const ** argv)
         options.isReportFile = true;
 
     // Get performance options.
-    getOptionValue(options.threadsCount, parser, "threads");
+    CharString threads;
+    int threadsCount(0);
+    getOptionValue(threads, parser, "threads");
+    if (threads == "auto")
+        options.threadsCount = autoThreadsCount();
+    else if (lexicalCast(threadsCount, threads) and threadsCount > 0)
+        options.threadsCount = threadsCount;
+    else
+    {
+        std::cerr << getAppName(parser) << "Number of threads must be a \
+        positive integer or auto" << std::endl;
+        return ArgumentParser::PARSE_ERROR;
+    }
+#ifndef _OPENMP
+    options.threadsCount = 1;
+#endif
+    options.isPinThreads = isSet(parser, "pin-threads");
     getOptionValue(options.readsBatch, parser, "reads-batch");
+    unsigned batchMemory(0);
+    if (getOptionValue(batchMemory, parser, "batch-memory"))
+    {
+        options.batchMemory = batchMemory * 1024ul * 1024ul;
+        if (!isSet(parser, "reads-batch"))
+            options.readsBatch = std::numeric_limits<long>::max();
+    }
+    getOptionValue(options.batchBuffers, parser, "batch-buffers");
+    getOptionValue(options.zstdLevel, parser, "zstd-level");
+    CharString simd;
+    getOptionValue(simd, parser, "simd");
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2,
+        SimdLevel::Avx2, SimdLevel::Avx512})
+        if (simd == simdLevelName(level))
+            options.simdLevel = level;
     getOptionValue(options.logLevel, parser, "verbose");
 
     // Get trimmers.
@@ -428,6 +606,122 @@ void configureTrimming(Options const & options)
         configureTrimming(options, Serial());
 }
 
+// ----------------------------------------------------------------------------
+// Function runWorkChunk()
+// ----------------------------------------------------------------------------
+
+// Trim the chunk as shard of the work directory, into files of this process
+// which are given their final names once complete.
+void runWorkChunk(Options const & options, WorkQueue const & queue,
+unsigned chunk, CharString const & lockFile)
+{
+    Options chunkOptions = options;
+    chunkOptions.shardIndex = chunk;
+    chunkOptions.shardCount = queue.chunks;
+    chunkOptions.isReportFile = true;
+
+    String<CharString> files;
+    String<CharString> ownerFiles;
+    auto redirect = [&](CharString & fileName, CharString const & suffix)
+    {
+        appendValue(files, chunkFileName(queue, chunk, suffix));
+        appendValue(ownerFiles, ownerFileName(queue, chunk, suffix));
+        fileName = back(ownerFiles);
+    };
+    auto baseName = [](CharString const & fileName)
+    {
+        std::string name = toCString(fileName);
+        return CharString(name.substr(name.find_last_of('/') + 1));
+    };
+    redirect(chunkOptions.outputFile.i1, baseName(options.outputFile.i1));
+    if (!empty(options.outputFile.i2))
+        redirect(chunkOptions.outputFile.i2, baseName(options.outputFile.i2));
+    if (options.isDiscardFile)
+        redirect(chunkOptions.discardFile, baseName(options.discardFile));
+    redirect(chunkOptions.reportFile, "json");
+    for (unsigned i = 0; i < length(files); ++i)
+        if (std::count(begin(files, Standard()), end(files, Standard()),
+            files[i]) > 1)
+            throw IOError("Error while opening work directory, output files "
+                "have the same name.");
+
+    WorkHeartbeat heartbeat;
+    start(heartbeat, lockFile, queue.timeout);
+    try
+    {
+        configureTrimming(chunkOptions);
+    }
+    catch (...)
+    {
+        stop(heartbeat);
+        for (CharString const & ownerFile : ownerFiles)
+            std::remove(toCString(ownerFile));
+        throw;
+    }
+    stop(heartbeat);
+
+    for (unsigned i = 0; i < length(files); ++i)
+        if (std::rename(toCString(ownerFiles[i]), toCString(files[i])) != 0)
+            throw IOError("Error while writing files in work directory.");
+    doneChunk(queue, chunk);
+}
+
+// ----------------------------------------------------------------------------
+// Function runWorkQueue()
+// ----------------------------------------------------------------------------
+
+// Claim chunks until all are done, waiting for the ones of other processes
+// in case they stop.  The report of the run is then merged by every process,
+// each one into its own file renamed over the report: the merge is the same
+// whichever process does it, and the report is written as long as one
+// process ends.
+void runWorkQueue(Options const & options)
+{
+    WorkQueue queue;
+    open(queue, toCString(options.workDir), options.workChunks,
+        options.workTimeout);
+    std::chrono::seconds poll(std::min(10u, std::max(1u, queue.timeout / 8)));
+
+    unsigned done = 0;
+    while (done < queue.chunks)
+    {
+        done = 0;
+        bool isClaimed = false;
+        for (unsigned chunk = 0; chunk < queue.chunks; ++chunk)
+        {
+            CharString lockFile;
+            if (isDone(queue, chunk))
+                ++done;
+            else if (claimChunk(lockFile, queue, chunk))
+            {
+                options.logger->info("Work chunk : {}/{}", chunk + 1,
+                    queue.chunks);
+                runWorkChunk(options, queue, chunk, lockFile);
+                isClaimed = true;
+            }
+        }
+        if (!isClaimed && done < queue.chunks)
+            std::this_thread::sleep_for(poll);
+    }
+
+    if (options.isReportFile)
+    {
+        Options mergeOptions = options;
+        append(mergeOptions.reportFile, "." + std::string(toCString(
+            queue.owner)) + ".tmp");
+        for (unsigned chunk = 0; chunk < queue.chunks; ++chunk)
+            appendValue(mergeOptions.reportMergeFiles,
+                chunkFileName(queue, chunk, "json"));
+        mergeReports(mergeOptions);
+        if (std::rename(toCString(mergeOptions.reportFile),
+            toCString(options.reportFile)) != 0)
+        {
+            std::remove(toCString(mergeOptions.reportFile));
+            throw IOError("Error while writing report file.");
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 // Function main()
 // ----------------------------------------------------------------------------
@@ -456,12 +750,40 @@ int main(int argc, char const ** argv)
     options.logger->info("Programme {}", toCString(getAppName(parser)));
     options.logger->info("Run : {}", toCString(options.commandLine));
     options.logger->debug("Using threads : {}", options.threadsCount);
+    options.logger->debug("Pin threads : {}", options.isPinThreads);
     options.logger->debug("Log level : {}", options.logLevel);
     options.logger->debug("Reads batch : {}", options.readsBatch);
+    options.logger->debug("Batch memory : {} bytes", options.batchMemory);
+    options.logger->debug("Batch buffers : {}", options.batchBuffers);
+    options.logger->debug("Zstd level : {}", options.zstdLevel);
+
+    // Kernels, bound before any thread starts.
+    if (options.simdLevel > cpuSimdLevel())
+    {
+        options.logger->warn("Instruction set {} not supported by the CPU",
+            simdLevelName(options.simdLevel));
+        options.simdLevel = cpuSimdLevel();
+    }
+    bindKernels(simdKernels(), options.simdLevel);
+    options.logger->debug("Instruction set : {}",
+        simdLevelName(simdKernels().level));
+    options.logger->debug("Gzip index : {}", options.isGzipIndex);
+    options.logger->debug("Record start : {}", options.recordStart);
+    options.logger->debug("Shard : {}/{}", options.shardIndex + 1,
+        options.shardCount);
+    options.logger->debug("Work directory : {}, {} chunks",
+        toCString(options.workDir), options.workChunks);
 
     try
     {
-        configureTrimming(options);
+        if (!empty(options.reportMergeFiles))
+            mergeReports(options);
+        else if (options.isGzipIndexOnly)
+            indexInputFiles(options);
+        else if (!empty(options.workDir))
+            runWorkQueue(options);
+        else
+            configureTrimming(options);
     }
     catch (Exception const & e)
     {
@@ -18,17 +18,29 @@
 // STL headers
 // ----------------------------------------------------------------------------
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <string>
+#include <thread>
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
 
 // ----------------------------------------------------------------------------
 // rapidjson headers
 // ----------------------------------------------------------------------------
 
 #include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
 #include <rapidjson/ostreamwrapper.h>
 #include <rapidjson/writer.h>
 
@@ -45,7 +57,9 @@
 
 #include "misc_tags.hpp"
 #include "seqs.hpp"
+#include "threads.hpp"
 #include "timer.hpp"
+#include "work_queue.hpp"
 
 using namespace seqan;
 
@@ -170,9 +184,24 @@ struct Options
 
     bool                    isDiscardFile;
     bool                    isReportFile;
-
+    bool                    isPinThreads;
+    bool                    isGzipIndex;
+    bool                    isGzipIndexOnly;
+
+    unsigned long           gzipIndexSpan;
+    unsigned long           recordStart;
+    unsigned                shardIndex;
+    unsigned                shardCount;
+    String<CharString>      reportMergeFiles;
+    CharString              workDir;
+    unsigned                workChunks;
+    unsigned                workTimeout;
     long                    readsBatch;
+    unsigned long           batchMemory;
+    unsigned                batchBuffers;
     unsigned                threadsCount;
+    int                     zstdLevel;
+    SimdLevel               simdLevel;
 
     CharString              commandLine;
     CharString              version;
@@ -193,11 +222,26 @@ struct Options
         sequencing(Sequencing::Undefined),
         isDiscardFile(false),
         isReportFile(false),
+        isPinThreads(false),
+        isGzipIndex(false),
+        isGzipIndexOnly(false),
+        gzipIndexSpan(32ul << 20),
+        recordStart(0),
+        shardIndex(0),
+        shardCount(1),
+        reportMergeFiles(),
+        workDir(),
+        workChunks(16),
+        workTimeout(600),
         readsBatch(1000000),
+        batchMemory(0),
+        batchBuffers(3),
         threadsCount(1),
+        zstdLevel(3),
+        simdLevel(cpuSimdLevel()),
         logLevel(4)
     {
-        logger = spdlog::stdout_logger_st("console");
+        logger = spdlog::stdout_logger_mt("console");
         logger->set_pattern("%d-%m-%Y %R - %l - %v");
         switch (logLevel) {
             case 1: logger->set_level(spdlog::level::critical); break;
@@ -212,7 +256,7 @@ struct Options
 
     static constexpr const char* getProcessExt()
     {
-        return "fq fastq fq.gz fastq.gz";
+        return "fq fastq fq.gz fastq.gz fq.bgz fastq.bgz fq.zst fastq.zst";
     }
     static constexpr const char* getReportExt()
     {
@@ -235,8 +279,13 @@ struct TrimmingTraits
 
     //Files
     typedef Pair<SeqFileIn>                     TReadsFileIn;
+    typedef Pair<FastqMap>                      TReadsMapIn;
+    typedef Pair<GzipFileIn>                    TReadsGzipIn;
+    typedef Pair<ZstdFileIn>                    TReadsZstdIn;
     typedef Pair<SeqFileOut>                    TReadsFileOut;
+    typedef Pair<BlockFileOut>                  TReadsBlockOut;
     typedef SeqFileOut                          TReadsFileDiscard;
+    typedef BlockFileOut                        TReadsBlockDiscard;
 };
 
 // ----------------------------------------------------------------------------
@@ -250,6 +299,7 @@ struct Stats
     TValue  keepReads;
 
     TValue  time;
+    TValue  batchMemoryMax;
 
     std::map<TValue, TValue>    distriBefore;
     std::map<TValue, TValue>    distriAfter;
@@ -258,11 +308,33 @@ struct Stats
         totalReads(0),
         keepReads(0),
         time(0),
+        batchMemoryMax(0),
         distriBefore(),
         distriAfter()
     {}
 };
 
+// ----------------------------------------------------------------------------
+// Class StageThreads
+// ----------------------------------------------------------------------------
+
+// Threads of the stages of the pipeline running at the same time: the
+// trimming team, then the reader and the writers with their OpenMP teams.
+struct StageThreads
+{
+    unsigned    trim;
+    unsigned    load;
+    unsigned    write;
+    unsigned    discard;
+
+    StageThreads() :
+        trim(1),
+        load(1),
+        write(1),
+        discard(0)
+    {}
+};
+
 // ----------------------------------------------------------------------------
 // Class Trimming
 // ----------------------------------------------------------------------------
@@ -278,15 +350,40 @@ struct Trimming
 
     //Store reads
     typedef SeqStore<void, SeqConfig<TConfig>>      TReads;
-    TReads                                          reads;
+    typedef ConcurrentQueue<TReads *, Suspendable<Limit>>  TReadsQueue;
+    String<TReads>                                  reads;
+
+    //CPUs used to pin threads
+    CpuTopology                                     topology;
+
+    //Threads of each stage, slots of the topology in this order when pinned
+    StageThreads                                    threads;
+
+    //Arenas of the batches moved to the nodes of the trimming threads, with
+    //the storage they had then
+    std::map<void const *, std::pair<void const *, std::size_t> > placed;
+
+    //Reads, or pairs of reads, left to load in the shard
+    unsigned long                                   recordsLeft;
+
+    //Trimmers asked for, in the order of the Trimmers TagList
+    TrimmerChain<Trimmers>                          chain;
 
     typename Traits::TReadsFileIn                   readsFileIn;
+    typename Traits::TReadsMapIn                    readsMapIn;
+    typename Traits::TReadsGzipIn                   readsGzipIn;
+    typename Traits::TReadsZstdIn                   readsZstdIn;
     typename Traits::TReadsFileOut                  readsFileOut;
+    typename Traits::TReadsBlockOut                 readsBlockOut;
     typename Traits::TReadsFileDiscard              readsFileDiscard;
+    typename Traits::TReadsBlockDiscard             readsBlockDiscard;
 
     Trimming(Options const & options) :
-        options(options)
-    {};
+        options(options),
+        recordsLeft(std::numeric_limits<unsigned long>::max())
+    {
+        setTrimmers(chain, options.trimmers);
+    };
 };
 
 // ============================================================================
@@ -300,7 +397,122 @@ struct Trimming
 template <typename TSpec, typename TConfig>
 inline void configureThreads(Trimming<TSpec, TConfig> & me)
 {
+    me.threads = StageThreads();
+    me.threads.trim = me.options.threadsCount;
     omp_set_num_threads(me.options.threadsCount);
+    if (me.options.isPinThreads)
+    {
+        initCpuTopology(me.topology);
+        pinOpenMPThreads(me.topology, me.options.threadsCount);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function pinStageThread()
+// ----------------------------------------------------------------------------
+
+// Reader and writers run on the CPUs of their count slots from first, after
+// the ones of the trimming team.  Returns the threads of their OpenMP teams,
+// no more than the CPUs they run on.
+template <typename TSpec, typename TConfig>
+inline unsigned pinStageThread(Trimming<TSpec, TConfig> const & me,
+unsigned first, unsigned count)
+{
+    if (me.options.isPinThreads)
+        pinThreadSlots(me.topology, first, count);
+    unsigned cpus = threadCpuCount();
+    if (cpus == 0)
+        return count;
+    return std::min(count, cpus);
+}
+
+// ----------------------------------------------------------------------------
+// Function shareThreads()
+// ----------------------------------------------------------------------------
+
+// The stages run at the same time, so they share threadsCount instead of
+// each one starting as many threads.  A stage without team, writing plain
+// files, takes one thread, the others share the rest equally and the
+// trimming team takes what is left over.  Each stage has one thread at
+// least.
+template <typename TSpec, typename TConfig>
+inline void shareThreads(Trimming<TSpec, TConfig> & me)
+{
+    bool isLoadTeam = isOpen(me.readsMapIn.i1) || isOpen(me.readsGzipIn.i1) ||
+        isOpen(me.readsZstdIn.i1);
+    bool isWriteTeam = isOpen(me.readsBlockOut.i1);
+    bool isDiscardTeam = isOpen(me.readsBlockDiscard);
+
+    unsigned teams = 1 + isLoadTeam + isWriteTeam + isDiscardTeam;
+    unsigned single = !isLoadTeam + !isWriteTeam +
+        (me.options.isDiscardFile && !isDiscardTeam);
+    unsigned left = me.options.threadsCount > single ?
+        me.options.threadsCount - single : 0;
+    unsigned share = std::max(1u, left / teams);
+
+    me.threads.load = isLoadTeam ? share : 1;
+    me.threads.write = isWriteTeam ? share : 1;
+    me.threads.discard = !me.options.isDiscardFile ? 0 :
+        isDiscardTeam ? share : 1;
+    unsigned shared = share * (teams - 1);
+    me.threads.trim = left > shared ? left - shared : 1;
+    me.options.logger->debug("Threads of stages : trim {}, load {}, write {}, "
+        "discard {}", me.threads.trim, me.threads.load, me.threads.write,
+        me.threads.discard);
+}
+
+// ----------------------------------------------------------------------------
+// Function placeArena()
+// ----------------------------------------------------------------------------
+
+// Move an arena to the nodes of the trimming threads once it is reallocated,
+// its pages then stay there for the next batches.
+template <typename TSpec, typename TConfig, typename TValue,
+typename TArenaSpec>
+inline void placeArena(Trimming<TSpec, TConfig> & me,
+String<TValue, Alloc<TArenaSpec> > const & arena)
+{
+    std::pair<void const *, std::size_t> storage(begin(arena, Standard()),
+        capacity(arena) * sizeof(TValue));
+    std::pair<void const *, std::size_t> & placed = me.placed[&arena];
+    if (placed == storage)
+        return;
+    placed = storage;
+    bindMemoryNodes(me.topology, me.threads.trim, storage.first,
+        storage.second);
+}
+
+template <typename TSpec, typename TConfig, typename TString,
+typename TSetSpec>
+inline void placeArena(Trimming<TSpec, TConfig> & me,
+StringSet<TString, Owner<ConcatDirect<TSetSpec> > > const & set)
+{
+    placeArena(me, set.concat);
+    placeArena(me, set.limits);
+}
+
+// ----------------------------------------------------------------------------
+// Function placeReads()
+// ----------------------------------------------------------------------------
+
+// Batches are filled by the reader and trimmed by the team, each thread on a
+// range of reads: with pinned threads, the arenas are cut between the nodes
+// of the team instead of staying on the node of the reader.
+template <typename TSpec, typename TConfig, typename TReads>
+inline void placeReads(Trimming<TSpec, TConfig> & me, TReads const & reads)
+{
+    if (!me.options.isPinThreads)
+        return;
+    placeArena(me, reads.names.i1);
+    placeArena(me, reads.seqs.i1);
+    placeArena(me, reads.windows.i1);
+    placeArena(me, reads.discards);
+    if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
+    {
+        placeArena(me, reads.names.i2);
+        placeArena(me, reads.seqs.i2);
+        placeArena(me, reads.windows.i2);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -353,6 +565,12 @@ inline void printStats(Trimming<TSpec, TConfig> const & me)
     kruntime.AddMember("unit", "seconds", allocator);
     kruntime.AddMember("value", me.stats.time, allocator);
     kanalyse.AddMember("runtime", kruntime, allocator);
+
+    rapidjson::Value kbatchmemory(rapidjson::kObjectType);
+    kbatchmemory.AddMember("unit", "bytes", allocator);
+    kbatchmemory.AddMember("value", 
+        static_cast<uint64_t>(me.stats.batchMemoryMax), allocator);
+    kanalyse.AddMember("batch_memory", kbatchmemory, allocator);
  
     TString ssequencing = "";
     switch(me.options.sequencing){
@@ -363,6 +581,17 @@ inline void printStats(Trimming<TSpec, TConfig> const & me)
     kanalyse.AddMember("sequencing", 
         rapidjson::StringRef(toCString(ssequencing)), 
         allocator);
+    kanalyse.AddMember("simd",
+        rapidjson::StringRef(simdLevelName(simdKernels().level)),
+        allocator);
+
+    if (me.options.shardCount > 1)
+    {
+        rapidjson::Value kshard(rapidjson::kObjectType);
+        kshard.AddMember("index", me.options.shardIndex + 1, allocator);
+        kshard.AddMember("count", me.options.shardCount, allocator);
+        kanalyse.AddMember("shard", kshard, allocator);
+    }
     
     rapidjson::Value kfilenames(rapidjson::kObjectType);
     rapidjson::Value kfilenamesInput(rapidjson::kArrayType);
@@ -422,6 +651,135 @@ inline void printStats(Trimming<TSpec, TConfig> const & me)
     document.Accept(writer);
 }
 
+// ----------------------------------------------------------------------------
+// Function mergeReports()
+// ----------------------------------------------------------------------------
+
+// Sum the statistics of the reports of all the shards of a run.  The analyze
+// is the one of the first report, with the outputs of all the shards, the
+// runtime of the longest one and the batch memory of the largest one.
+inline bool _isReport(rapidjson::Document const & report)
+{
+    if (report.HasParseError() || !report.IsObject() ||
+        !report.HasMember("analyze") || !report.HasMember("statistics"))
+        return false;
+    rapidjson::Value const & analyze = report["analyze"];
+    rapidjson::Value const & statistics = report["statistics"];
+    return analyze.IsObject() && statistics.IsObject() &&
+        analyze.HasMember("runtime") && analyze["runtime"].IsObject() &&
+        analyze["runtime"].HasMember("value") &&
+        analyze["runtime"]["value"].IsUint64() &&
+        analyze.HasMember("batch_memory") &&
+        analyze["batch_memory"].IsObject() &&
+        analyze["batch_memory"].HasMember("value") &&
+        analyze["batch_memory"]["value"].IsUint64() &&
+        analyze.HasMember("file") && analyze["file"].IsObject() &&
+        analyze["file"].HasMember("output") &&
+        analyze["file"]["output"].IsArray() &&
+        statistics.HasMember("total") && statistics["total"].IsUint64() &&
+        statistics.HasMember("kept") && statistics["kept"].IsUint64() &&
+        statistics.HasMember("length_reads_before") &&
+        statistics["length_reads_before"].IsObject() &&
+        statistics.HasMember("length_reads_after") &&
+        statistics["length_reads_after"].IsObject();
+}
+
+inline void _mergeStatsMap(std::map<unsigned long, unsigned long> & map,
+rapidjson::Value const & jsonValue)
+{
+    for (auto it = jsonValue.MemberBegin(); it != jsonValue.MemberEnd(); ++it)
+    {
+        if (!it->value.IsUint64())
+            throw IOError("Error while reading report file.");
+        map[std::stoul(it->name.GetString())] += it->value.GetUint64();
+    }
+}
+
+inline void mergeReports(Options const & options)
+{
+    rapidjson::Document document;
+    rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
+    rapidjson::Value outputs(rapidjson::kArrayType);
+    std::map<unsigned long, unsigned long> distriBefore, distriAfter;
+    uint64_t totalReads = 0, keepReads = 0, time = 0, batchMemoryMax = 0;
+    String<bool> shards;
+
+    for (CharString const & reportFile : options.reportMergeFiles)
+    {
+        std::ifstream ifs(toCString(reportFile));
+        rapidjson::IStreamWrapper ifw(ifs);
+        rapidjson::Document report;
+        report.ParseStream(ifw);
+        if (!_isReport(report))
+            throw IOError("Error while reading report file.");
+        rapidjson::Value const & analyze = report["analyze"];
+        rapidjson::Value const & statistics = report["statistics"];
+
+        // Every shard once.
+        unsigned index = 1, count = 1;
+        if (analyze.HasMember("shard") && analyze["shard"].IsObject() &&
+            analyze["shard"].HasMember("index") &&
+            analyze["shard"].HasMember("count") &&
+            analyze["shard"]["index"].IsUint() &&
+            analyze["shard"]["count"].IsUint())
+        {
+            index = analyze["shard"]["index"].GetUint();
+            count = analyze["shard"]["count"].GetUint();
+        }
+        if (empty(shards))
+            resize(shards, count, false);
+        if (count != length(shards) || index == 0 || index > count ||
+            shards[index - 1])
+            throw RuntimeError("Error while merging reports, each shard of "
+                               "the run is expected once.");
+        shards[index - 1] = true;
+
+        totalReads += statistics["total"].GetUint64();
+        keepReads += statistics["kept"].GetUint64();
+        _mergeStatsMap(distriBefore, statistics["length_reads_before"]);
+        _mergeStatsMap(distriAfter, statistics["length_reads_after"]);
+        time = std::max<uint64_t>(time, analyze["runtime"]["value"].GetUint64());
+        batchMemoryMax = std::max<uint64_t>(batchMemoryMax,
+            analyze["batch_memory"]["value"].GetUint64());
+        for (auto const & output : analyze["file"]["output"].GetArray())
+            outputs.PushBack(rapidjson::Value(output, allocator), allocator);
+        if (document.IsNull())
+            document.CopyFrom(report, allocator);
+    }
+    if (std::find(begin(shards, Standard()), end(shards, Standard()), false) !=
+        end(shards, Standard()))
+        throw RuntimeError("Error while merging reports, each shard of the "
+                           "run is expected once.");
+
+    rapidjson::Value & analyze = document["analyze"];
+    analyze.EraseMember("shard");
+    analyze["runtime"]["value"].SetUint64(time);
+    analyze["batch_memory"]["value"].SetUint64(batchMemoryMax);
+    analyze["file"]["output"] = outputs;
+
+    rapidjson::Value & kstatistics = document["statistics"];
+    kstatistics.SetObject();
+    kstatistics.AddMember("total", totalReads, allocator);
+    kstatistics.AddMember("kept", keepReads, allocator);
+    kstatistics.AddMember("discarded", totalReads - keepReads, allocator);
+
+    rapidjson::Value kdistributionBefore(rapidjson::kObjectType);
+    printStatsMap(kdistributionBefore, distriBefore, document);
+    kstatistics.AddMember("length_reads_before", 
+    kdistributionBefore, allocator);
+
+    rapidjson::Value kdistributionAfter(rapidjson::kObjectType);
+    printStatsMap(kdistributionAfter, distriAfter, document);
+    kstatistics.AddMember("length_reads_after", 
+    kdistributionAfter, allocator);
+
+    // Write output.
+    std::ofstream ofs(toCString(options.reportFile));
+    rapidjson::OStreamWrapper ofw(ofs); 
+    rapidjson::Writer<rapidjson::OStreamWrapper> writer(ofw);
+    document.Accept(writer);
+}
+
 // ----------------------------------------------------------------------------
 // Function open() - open paired file
 // ----------------------------------------------------------------------------
@@ -434,6 +792,22 @@ inline bool open(Pair<FormattedFile<TFileType, TDirection, TSpec> > & me,
     return open(me.i1, fileName1) && open(me.i2, fileName2);
 }
 
+// ----------------------------------------------------------------------------
+// Function setInputThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the OpenMP teams of the input files.
+template <typename TSpec, typename TConfig>
+inline void setInputThreads(Trimming<TSpec, TConfig> & me, unsigned threads)
+{
+    setThreads(me.readsMapIn.i1, threads);
+    setThreads(me.readsMapIn.i2, threads);
+    setThreads(me.readsGzipIn.i1, threads);
+    setThreads(me.readsGzipIn.i2, threads);
+    setThreads(me.readsZstdIn.i1, threads);
+    setThreads(me.readsZstdIn.i2, threads);
+}
+
 // ----------------------------------------------------------------------------
 // Function openInputFile()
 // ----------------------------------------------------------------------------
@@ -472,14 +846,371 @@ _openReadsInput(Trimming<TSpec, TConfig> & me, SequencingPaired, FInterleaved)
         throw RuntimeError("Error while opening reads file.");
 }
 
+// Plain FASTQ files are mapped, gzip and zstd files are mapped and
+// decompressed on all the threads, the others are read through a SeqFileIn.
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline bool
+_openReadsMap(Trimming<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
+SequencingSingle, FFastq)
+{
+    return open(fileIn.i1, toCString(me.options.inputFile.i1));
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline bool
+_openReadsMap(Trimming<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
+SequencingSingle, FInterleaved)
+{
+    return open(fileIn.i1, toCString(me.options.inputFile.i1));
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline bool
+_openReadsMap(Trimming<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
+SequencingPaired, FFastq)
+{
+    return open(fileIn, 
+        toCString(me.options.inputFile.i1), 
+        toCString(me.options.inputFile.i2));
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline bool
+_openReadsMap(Trimming<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
+SequencingPaired, FInterleaved)
+{
+    return open(fileIn.i1, toCString(me.options.inputFile.i1));
+}
+
 template <typename TSpec, typename TConfig>
 inline void openInputFile(Trimming<TSpec, TConfig> & me)
 {
+    setInputThreads(me, me.options.threadsCount);
+    if (_openReadsMap(me, me.readsMapIn,
+        typename TConfig::TSequencing(),
+        typename TConfig::TInputFormat()))
+    {
+        me.options.logger->debug("\tInput mapped");
+        return;
+    }
+    if (_openReadsMap(me, me.readsGzipIn,
+        typename TConfig::TSequencing(),
+        typename TConfig::TInputFormat()))
+    {
+        me.options.logger->debug("\tInput mapped and decompressed");
+        return;
+    }
+    if (_openReadsMap(me, me.readsZstdIn,
+        typename TConfig::TSequencing(),
+        typename TConfig::TInputFormat()))
+    {
+        me.options.logger->debug("\tInput mapped and decompressed");
+        return;
+    }
     _openReadsInput(me, 
         typename TConfig::TSequencing(),
         typename TConfig::TInputFormat());
 }
 
+// ----------------------------------------------------------------------------
+// Function indexInputFiles()
+// ----------------------------------------------------------------------------
+
+// Only build the index of gzip input files, reading them to their end.
+inline void _indexInputFile(Options const & options,
+CharString const & fileName)
+{
+    GzipFileIn fileIn;
+    setThreads(fileIn, options.threadsCount);
+    if (!open(fileIn, toCString(fileName)))
+        throw RuntimeError("Error while opening reads file, only gzip files "
+                           "are indexed.");
+    CharString indexFile = indexFileName(toCString(fileName));
+    buildIndex(fileIn, toCString(indexFile), options.gzipIndexSpan);
+    unsigned long records = skipRecords(fileIn,
+        std::numeric_limits<unsigned long>::max());
+    unsigned checkpoints = length(fileIn.index.checkpoints);
+    close(fileIn);
+    options.logger->info("Index written : {}, {} reads, {} checkpoints",
+        toCString(indexFile), records, checkpoints);
+}
+
+inline void indexInputFiles(Options const & options)
+{
+    _indexInputFile(options, options.inputFile.i1);
+    if (!empty(options.inputFile.i2))
+        _indexInputFile(options, options.inputFile.i2);
+}
+
+// ----------------------------------------------------------------------------
+// Function shardInputFile()
+// ----------------------------------------------------------------------------
+
+// Keep shard options.shardIndex of options.shardCount of the reads.  Plain
+// files are cut in equal parts of bytes, moved to the next record start.
+// Mates, and pairs of interleaved files, are then matched by counting lines,
+// records must be on 4 lines.  Gzip files are cut in equal parts of reads
+// from their index, built first when missing.
+inline std::size_t _shardBound(FastqMap const & fileIn, unsigned k,
+unsigned count)
+{
+    if (k == 0)
+        return 0;
+    if (k >= count)
+        return fileIn.size;
+    return findRecordStart(fileIn.data + fileIn.size / count * k,
+        fileIn.data, fileIn.data + fileIn.size) - fileIn.data;
+}
+
+inline void _checkShardBound(FastqMap const & fileIn, std::size_t pos,
+uint64_t lines)
+{
+    if (pos < fileIn.size && (lines % 4 != 0 || fileIn.data[pos] != '@'))
+        throw RuntimeError("Error while sharding reads file, reads are "
+                           "matched on records of 4 lines only.");
+}
+
+template <typename TSpec, typename TConfig, typename TFormat>
+inline void
+_shardReads(Trimming<TSpec, TConfig> & me, Pair<FastqMap> & fileIn,
+SequencingSingle, TFormat)
+{
+    unsigned k = me.options.shardIndex;
+    unsigned count = me.options.shardCount;
+    setRange(fileIn.i1, _shardBound(fileIn.i1, k, count),
+        _shardBound(fileIn.i1, k + 1, count));
+}
+
+template <typename TSpec, typename TConfig>
+inline void
+_shardReads(Trimming<TSpec, TConfig> & me, Pair<FastqMap> & fileIn,
+SequencingPaired, FFastq)
+{
+    unsigned k = me.options.shardIndex;
+    unsigned count = me.options.shardCount;
+    FastqMap & fileIn1 = fileIn.i1;
+    FastqMap & fileIn2 = fileIn.i2;
+
+    // The reverse file is cut after as many lines as the forward one.
+    std::size_t from1 = _shardBound(fileIn1, k, count);
+    std::size_t to1 = _shardBound(fileIn1, k + 1, count);
+    uint64_t linesFrom = countLines(fileIn1, 0, from1);
+    uint64_t linesTo = linesFrom + countLines(fileIn1, from1, to1);
+    std::size_t from2 = from1 < fileIn1.size ?
+        findLine(fileIn2, 0, linesFrom) : fileIn2.size;
+    std::size_t to2 = to1 < fileIn1.size ?
+        findLine(fileIn2, from2, linesTo - linesFrom) : fileIn2.size;
+    _checkShardBound(fileIn1, from1, linesFrom);
+    _checkShardBound(fileIn2, from2, linesFrom);
+    _checkShardBound(fileIn1, to1, linesTo);
+    _checkShardBound(fileIn2, to2, linesTo);
+    setRange(fileIn1, from1, to1);
+    setRange(fileIn2, from2, to2);
+}
+
+template <typename TSpec, typename TConfig>
+inline void
+_shardReads(Trimming<TSpec, TConfig> & me, Pair<FastqMap> & fileIn,
+SequencingPaired, FInterleaved)
+{
+    unsigned k = me.options.shardIndex;
+    unsigned count = me.options.shardCount;
+    FastqMap & fileIn1 = fileIn.i1;
+
+    // Bounds on the forward read of a pair, an even record.
+    std::size_t from = _shardBound(fileIn1, k, count);
+    std::size_t to = _shardBound(fileIn1, k + 1, count);
+    uint64_t linesFrom = countLines(fileIn1, 0, from);
+    uint64_t linesTo = linesFrom + countLines(fileIn1, from, to);
+    _checkShardBound(fileIn1, from, linesFrom);
+    _checkShardBound(fileIn1, to, linesTo);
+    if (from < fileIn1.size && linesFrom % 8 != 0)
+        from = findLine(fileIn1, from, 4);
+    if (to < fileIn1.size && linesTo % 8 != 0)
+        to = findLine(fileIn1, to, 4);
+    setRange(fileIn1, from, to);
+}
+
+template <typename TSpec, typename TConfig>
+inline void
+_indexShard(Trimming<TSpec, TConfig> & me, GzipFileIn & fileIn,
+CharString const & fileName)
+{
+    if (!isOpen(fileIn))
+        return;
+    CharString indexFile = indexFileName(toCString(fileName));
+    if (!loadIndex(fileIn, toCString(indexFile)))
+    {
+        _indexInputFile(me.options, fileName);
+        if (!loadIndex(fileIn, toCString(indexFile)))
+            throw IOError("Error while reading index file.");
+    }
+}
+
+template <typename TSpec, typename TConfig, typename TSequencing,
+typename TFormat>
+inline void
+_shardReads(Trimming<TSpec, TConfig> & me, Pair<GzipFileIn> & fileIn,
+TSequencing, TFormat)
+{
+    unsigned long k = me.options.shardIndex;
+    unsigned long count = me.options.shardCount;
+    _indexShard(me, fileIn.i1, me.options.inputFile.i1);
+    _indexShard(me, fileIn.i2, me.options.inputFile.i2);
+
+    unsigned long reads = fileIn.i1.index.records;
+    if (IsSameType<TFormat, FInterleaved>::VALUE)
+        reads /= 2;
+    unsigned long from = reads / count * k + reads % count * k / count;
+    unsigned long to = reads / count * (k + 1) + reads % count * (k + 1) /
+        count;
+    _seekReads(me, fileIn, from);
+    me.recordsLeft = to - from;
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn,
+typename TSequencing, typename TFormat>
+inline void
+_shardReads(Trimming<TSpec, TConfig> &, Pair<TFileIn> &, TSequencing, TFormat)
+{
+    throw RuntimeError("Error while sharding reads file, only plain and gzip "
+                       "files are sharded.");
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline void _shardReads(Trimming<TSpec, TConfig> & me, Pair<TFileIn> & fileIn)
+{
+    _shardReads(me, fileIn,
+        typename TConfig::TSequencing(),
+        typename TConfig::TInputFormat());
+}
+
+template <typename TSpec, typename TConfig>
+inline void shardInputFile(Trimming<TSpec, TConfig> & me)
+{
+    me.options.logger->debug("\tShard : {}/{}", me.options.shardIndex + 1,
+        me.options.shardCount);
+    if (isOpen(me.readsMapIn.i1))
+        _shardReads(me, me.readsMapIn);
+    else if (isOpen(me.readsGzipIn.i1))
+        _shardReads(me, me.readsGzipIn);
+    else if (isOpen(me.readsZstdIn.i1))
+        _shardReads(me, me.readsZstdIn);
+    else
+        _shardReads(me, me.readsFileIn);
+}
+
+// ----------------------------------------------------------------------------
+// Function seekInputFile()
+// ----------------------------------------------------------------------------
+
+// Gzip inputs use their index FILE.hmi, built while they are read when it is
+// missing.  Reads before options.recordStart are then skipped, gzip inputs
+// restart from the last checkpoint before it, the others parse them.
+template <typename TSpec, typename TConfig>
+inline void
+_indexInput(Trimming<TSpec, TConfig> & me, GzipFileIn & fileIn,
+CharString const & fileName)
+{
+    if (!isOpen(fileIn))
+        return;
+    CharString indexFile = indexFileName(toCString(fileName));
+    if (loadIndex(fileIn, toCString(indexFile)))
+    {
+        me.options.logger->debug("\tIndex loaded : {}", toCString(indexFile));
+        return;
+    }
+    buildIndex(fileIn, toCString(indexFile), me.options.gzipIndexSpan);
+    me.options.logger->debug("\tIndex built : {}", toCString(indexFile));
+}
+
+template <typename TFileIn, typename TSize>
+inline void _seekInput(TFileIn & fileIn, TSize record)
+{
+    skipRecords(fileIn, record);
+}
+
+template <typename TSize>
+inline void _seekInput(GzipFileIn & fileIn, TSize record)
+{
+    if (!seekRecord(fileIn, record))
+        skipRecords(fileIn, record);
+}
+
+template <typename TFileIn, typename TFormat>
+inline void
+_seekReads(Pair<TFileIn> & fileIn, unsigned long record, SequencingSingle,
+TFormat)
+{
+    _seekInput(fileIn.i1, record);
+}
+
+template <typename TFileIn>
+inline void
+_seekReads(Pair<TFileIn> & fileIn, unsigned long record, SequencingPaired,
+FFastq)
+{
+    _seekInput(fileIn.i1, record);
+    _seekInput(fileIn.i2, record);
+}
+
+template <typename TFileIn>
+inline void
+_seekReads(Pair<TFileIn> & fileIn, unsigned long record, SequencingPaired,
+FInterleaved)
+{
+    _seekInput(fileIn.i1, 2 * record);
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn>
+inline void _seekReads(Trimming<TSpec, TConfig> &, Pair<TFileIn> & fileIn,
+unsigned long record)
+{
+    _seekReads(fileIn, record,
+        typename TConfig::TSequencing(),
+        typename TConfig::TInputFormat());
+}
+
+template <typename TSpec, typename TConfig>
+inline void seekInputFile(Trimming<TSpec, TConfig> & me)
+{
+    if (me.options.shardCount > 1)
+    {
+        shardInputFile(me);
+        return;
+    }
+    if (me.options.isGzipIndex)
+    {
+        _indexInput(me, me.readsGzipIn.i1, me.options.inputFile.i1);
+        _indexInput(me, me.readsGzipIn.i2, me.options.inputFile.i2);
+    }
+    if (me.options.recordStart == 0)
+        return;
+
+    unsigned long record = me.options.recordStart;
+    me.options.logger->debug("\tSkip to read : {}", record);
+    if (isOpen(me.readsMapIn.i1))
+        _seekReads(me, me.readsMapIn, record);
+    else if (isOpen(me.readsGzipIn.i1))
+        _seekReads(me, me.readsGzipIn, record);
+    else if (isOpen(me.readsZstdIn.i1))
+        _seekReads(me, me.readsZstdIn, record);
+    else
+        _seekReads(me, me.readsFileIn, record);
+}
+
+// ----------------------------------------------------------------------------
+// Function setOutputThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the OpenMP teams of the output files.
+template <typename TSpec, typename TConfig>
+inline void setOutputThreads(Trimming<TSpec, TConfig> & me, unsigned threads)
+{
+    setThreads(me.readsBlockOut.i1, threads);
+    setThreads(me.readsBlockOut.i2, threads);
+}
+
 // ----------------------------------------------------------------------------
 // Function openOutputFile()
 // ----------------------------------------------------------------------------
@@ -518,9 +1249,48 @@ _openReadsOutput(Trimming<TSpec, TConfig> & me, SequencingPaired, FInterleaved)
         throw RuntimeError("Error while opening reads file.");
 }
 
+// Gzip, BGZF and zstd files are compressed by blocks on all the threads, the
+// others are written through a SeqFileOut.
+template <typename TSpec, typename TConfig>
+inline bool
+_openReadsBlock(Trimming<TSpec, TConfig> & me, SequencingSingle, FFastq)
+{
+    return open(me.readsBlockOut.i1, toCString(me.options.outputFile.i1));
+}
+
+template <typename TSpec, typename TConfig>
+inline bool
+_openReadsBlock(Trimming<TSpec, TConfig> & me, SequencingSingle, FInterleaved)
+{
+    return open(me.readsBlockOut.i1, toCString(me.options.outputFile.i1));
+}
+
+template <typename TSpec, typename TConfig>
+inline bool
+_openReadsBlock(Trimming<TSpec, TConfig> & me, SequencingPaired, FFastq)
+{
+    return open(me.readsBlockOut, 
+        toCString(me.options.outputFile.i1), 
+        toCString(me.options.outputFile.i2));
+}
+
+template <typename TSpec, typename TConfig>
+inline bool
+_openReadsBlock(Trimming<TSpec, TConfig> & me, SequencingPaired, FInterleaved)
+{
+    return open(me.readsBlockOut.i1, toCString(me.options.outputFile.i1));
+}
+
 template <typename TSpec, typename TConfig>
 inline void openOutputFile(Trimming<TSpec, TConfig> & me)
 {
+    setOutputThreads(me, me.options.threadsCount);
+    me.readsBlockOut.i1.level = me.options.zstdLevel;
+    me.readsBlockOut.i2.level = me.options.zstdLevel;
+    if (_openReadsBlock(me, 
+        typename TConfig::TSequencing(), 
+        typename TConfig::TOutputFormat()))
+        return;
     _openReadsOutput(me, 
         typename TConfig::TSequencing(), 
         typename TConfig::TOutputFormat());
@@ -533,6 +1303,10 @@ inline void openOutputFile(Trimming<TSpec, TConfig> & me)
 template <typename TSpec, typename TConfig>
 inline void openDiscardFile(Trimming<TSpec, TConfig> & me)
 {
+    setThreads(me.readsBlockDiscard, me.options.threadsCount);
+    me.readsBlockDiscard.level = me.options.zstdLevel;
+    if (open(me.readsBlockDiscard, toCString(me.options.discardFile)))
+        return;
     if (!open(me.readsFileDiscard, toCString(me.options.discardFile)))
         throw RuntimeError("Error while opening reads file.");
 }
@@ -585,6 +1359,24 @@ SequencingPaired, FFastq)
 template <typename TSpec, typename TConfig>
 inline void closeInputFile(Trimming<TSpec, TConfig> & me)
 {
+    if (isOpen(me.readsMapIn.i1))
+    {
+        close(me.readsMapIn.i1);
+        close(me.readsMapIn.i2);
+        return;
+    }
+    if (isOpen(me.readsGzipIn.i1))
+    {
+        close(me.readsGzipIn.i1);
+        close(me.readsGzipIn.i2);
+        return;
+    }
+    if (isOpen(me.readsZstdIn.i1))
+    {
+        close(me.readsZstdIn.i1);
+        close(me.readsZstdIn.i2);
+        return;
+    }
     close(me.readsFileIn, 
     typename TConfig::TSequencing(), 
     typename TConfig::TInputFormat());
@@ -597,6 +1389,12 @@ inline void closeInputFile(Trimming<TSpec, TConfig> & me)
 template <typename TSpec, typename TConfig>
 inline void closeOutputFile(Trimming<TSpec, TConfig> & me)
 {
+    if (isOpen(me.readsBlockOut.i1))
+    {
+        close(me.readsBlockOut.i1);
+        close(me.readsBlockOut.i2);
+        return;
+    }
     close(me.readsFileOut, 
     typename TConfig::TSequencing(), 
     typename TConfig::TOutputFormat());
@@ -609,50 +1407,82 @@ inline void closeOutputFile(Trimming<TSpec, TConfig> & me)
 template <typename TSpec, typename TConfig>
 inline void closeDiscardFile(Trimming<TSpec, TConfig> & me)
 {
-    close(me.readsFileDiscard);
+    if (isOpen(me.readsBlockDiscard))
+        close(me.readsBlockDiscard);
+    else
+        close(me.readsFileDiscard);
 }
 
 // ----------------------------------------------------------------------------
 // Function loadReads()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void loadReads(Trimming<TSpec, TConfig> & me)
+// Batches stop at the reads left in the shard.  Records of interleaved files
+// are counted one per mate.
+template <typename TSpec, typename TConfig, typename TReads>
+inline void loadReads(Trimming<TSpec, TConfig> & me, TReads & reads)
 {
-    readRecords(me.reads, me.readsFileIn, me.options.readsBatch);
+    unsigned long mates = IsSameType<typename TConfig::TInputFormat,
+        FInterleaved>::VALUE ? 2 : 1;
+    long readsBatch = me.options.readsBatch;
+    if (me.recordsLeft < static_cast<unsigned long>(readsBatch) / mates)
+        readsBatch = me.recordsLeft * mates;
+
+    if (isOpen(me.readsMapIn.i1))
+        readRecords(reads, me.readsMapIn, readsBatch,
+            me.options.batchMemory);
+    else if (isOpen(me.readsGzipIn.i1))
+        readRecords(reads, me.readsGzipIn, readsBatch,
+            me.options.batchMemory);
+    else if (isOpen(me.readsZstdIn.i1))
+        readRecords(reads, me.readsZstdIn, readsBatch,
+            me.options.batchMemory);
+    else
+        readRecords(reads, me.readsFileIn, readsBatch,
+            me.options.batchMemory);
+    me.recordsLeft -= std::min<unsigned long>(me.recordsLeft,
+        length(reads.seqs.i1));
+    unsigned long bytes = memoryFootprint(reads);
+    me.stats.batchMemoryMax = std::max(me.stats.batchMemoryMax, bytes);
+    me.options.logger->debug("\tBatch memory : {} bytes", bytes);
 }
 
 // ----------------------------------------------------------------------------
 // Function writeReadsDiscard()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void writeReadsDiscard(Trimming<TSpec, TConfig> & me)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void writeReadsDiscard(Trimming<TSpec, TConfig> & me, TReads & reads)
 {
-    writeRecords(me.reads, me.readsFileDiscard);
+    if (isOpen(me.readsBlockDiscard))
+        writeRecords(reads, me.readsBlockDiscard);
+    else
+        writeRecords(reads, me.readsFileDiscard);
 }
 
 // ----------------------------------------------------------------------------
 // Function statsDistribution()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void statsDistributionReads(Trimming<TSpec, TConfig> & me, Before)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void statsDistributionReads(Trimming<TSpec, TConfig> & me,
+TReads & reads, Before)
 {
-    statsDistributionReads(me.reads.seqs.i1, me.stats.distriBefore);
+    statsDistributionReads(reads.seqs.i1, me.stats.distriBefore);
     if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
     {
-        statsDistributionReads(me.reads.seqs.i2, me.stats.distriBefore);
+        statsDistributionReads(reads.seqs.i2, me.stats.distriBefore);
     }
 }
 
-template <typename TSpec, typename TConfig>
-inline void statsDistributionReads(Trimming<TSpec, TConfig> & me, After)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void statsDistributionReads(Trimming<TSpec, TConfig> & me,
+TReads & reads, After)
 {
-    statsDistributionReads(me.reads.seqs.i1, me.stats.distriAfter);
+    statsDistributionReads(reads.seqs.i1, me.stats.distriAfter);
     if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
     {
-        statsDistributionReads(me.reads.seqs.i2, me.stats.distriAfter);
+        statsDistributionReads(reads.seqs.i2, me.stats.distriAfter);
     }
 }
 
@@ -660,92 +1490,266 @@ inline void statsDistributionReads(Trimming<TSpec, TConfig> & me, After)
 // Function writeReads()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void writeReads(Trimming<TSpec, TConfig> & me)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void writeReads(Trimming<TSpec, TConfig> & me, TReads & reads)
 {
-    writeRecords(me.reads, me.readsFileOut);
+    if (isOpen(me.readsBlockOut.i1))
+        writeRecords(reads, me.readsBlockOut);
+    else
+        writeRecords(reads, me.readsFileOut);
 }
 
 // ----------------------------------------------------------------------------
-// Function chooseTrimmer()
+// Function trim()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void trim(Trimming<TSpec, TConfig> & me)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void trim(Trimming<TSpec, TConfig> & me, TReads & reads)
 {
-    chooseTrimmer(me.reads, me.options.trimmers, Trimmers());
+    trim(reads, me.chain);
 }
 
 // ----------------------------------------------------------------------------
 // Function clearReads()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void clearReads(Trimming<TSpec, TConfig> & me)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void clearReads(Trimming<TSpec, TConfig> &, TReads & reads)
 {
-    clear(me.reads);
+    clear(reads);
 }
 
 // ----------------------------------------------------------------------------
-// Function runTrimming()
+// Function stageLoad() - read a batch
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void runTrimming(Trimming<TSpec, TConfig> & me)
+template <typename TSpec, typename TConfig, typename TReads>
+inline void stageLoad(Trimming<TSpec, TConfig> & me, TReads & reads)
 {
-    me.options.logger->trace("Start timer");
-    start(me.timer);
+    loadReads(me, reads);
+    if (me.options.isReportFile)
+    {
+        size(reads, me.stats.totalReads);
+        statsDistributionReads(me, reads, Before());
+    }
+}
 
-    // Configure threads.
-    me.options.logger->trace("Configure threading with OpenMP");
-    configureThreads(me);
+// ----------------------------------------------------------------------------
+// Function stageTrim() - trim a batch and split kept/discarded reads
+// ----------------------------------------------------------------------------
 
-    // Open.
-    me.options.logger->info("Open files Input");
-    openInputFile(me);
-    me.options.logger->trace("Open files Output");
-    openOutputFile(me);
+template <typename TSpec, typename TConfig, typename TReads>
+inline void stageTrim(Trimming<TSpec, TConfig> & me, TReads & reads)
+{
+    me.options.logger->debug("\tTrim");
+    trim(me, reads);
+    me.options.logger->debug("\tUpdate");
     if (me.options.isDiscardFile)
+        update(reads, SeqStoreRemove());
+    else
+        update(reads);
+    if (me.options.isReportFile)
     {
-        openDiscardFile(me);
+        size(reads, me.stats.keepReads);
+        statsDistributionReads(me, reads, After());
     }
-    // Process reads in blocks.
+}
+
+// ----------------------------------------------------------------------------
+// Function runStage() - run one stage of the pipeline
+// ----------------------------------------------------------------------------
+
+// Pop batches from the input queue, process them and push them to the output
+// queue.  The queues are released on exit, even on error, so the neighbouring
+// stages always drain and stop.
+template <typename TQueue, typename TFunc>
+inline void runStage(TQueue & queueIn, TQueue & queueOut,
+std::atomic<bool> & aborted, std::exception_ptr & error, TFunc && func)
+{
+    typedef typename Value<TQueue>::Type        TReadsPtr;
+
+    TReadsPtr reads = NULL;
+    try
+    {
+        while (!aborted && popFront(reads, queueIn))
+        {
+            if (!func(*reads))
+                break;
+            appendValue(queueOut, reads);
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+        aborted = true;
+    }
+    unlockReading(queueIn);
+    unlockWriting(queueOut);
+}
+
+// ----------------------------------------------------------------------------
+// Function runTrimming()
+// ----------------------------------------------------------------------------
+
+// Serial: load, trim and write each batch one after another.
+template <typename TSpec, typename TConfig>
+inline void runTrimming(Trimming<TSpec, TConfig> & me, Serial)
+{
+    typedef typename Trimming<TSpec, TConfig>::TReads   TReads;
+
+    resize(me.reads, 1);
+    TReads & reads = me.reads[0];
+
     unsigned batch = 1;
     while (true)
     {
         me.options.logger->debug("Batch : {}", batch);
         me.options.logger->debug("\tLoad");
-        loadReads(me);
-        if (me.options.isReportFile)
-        {
-            size(me.reads, me.stats.totalReads);
-            statsDistributionReads(me, Before());
-        }
-        if (empty(me.reads)) break;
-        me.options.logger->debug("\tTrim");
-        trim(me);
+        stageLoad(me, reads);
+        if (empty(reads)) break;
+        stageTrim(me, reads);
         if (me.options.isDiscardFile)
         {
-            me.options.logger->debug("\tUpdate discard");
-            updateDiscard(me.reads);
             me.options.logger->debug("\tWrite discard");
-            writeReadsDiscard(me);
-        }
-        me.options.logger->debug("\tUpdate");
-        update(me.reads);
-        if (me.options.isReportFile)
-        {
-            size(me.reads, me.stats.keepReads);
-            statsDistributionReads(me, After());
+            writeReadsDiscard(me, reads);
         }
         me.options.logger->debug("\tWrite");
-        writeReads(me);
+        writeReads(me, reads);
         me.options.logger->debug("\tClear");
-        clear(me.reads);
+        clearReads(me, reads);
 
         // Update.
         ++batch;
     }
+}
+
+// Parallel: the reader, the trimmers and the writers work on different
+// batches at the same time.  Batches go round the ring
+// recycled -> load -> trim -> write (-> write discard) -> recycled, so at
+// most options.batchBuffers batches are in memory.
+template <typename TSpec, typename TConfig>
+inline void runTrimming(Trimming<TSpec, TConfig> & me, Parallel)
+{
+    typedef Trimming<TSpec, TConfig>                    TTrimming;
+    typedef typename TTrimming::TReads                  TReads;
+    typedef typename TTrimming::TReadsQueue             TReadsQueue;
+
+    unsigned buffers = me.options.batchBuffers;
+    resize(me.reads, buffers);
+
+    TReadsQueue recycled(buffers);
+    TReadsQueue loaded(buffers);
+    TReadsQueue trimmed(buffers);
+    TReadsQueue written(buffers);
+    for (unsigned i = 0; i < buffers; ++i)
+    {
+        appendValue(recycled, &me.reads[i]);
+    }
+
+    // Last queue of the ring, before the batch is recycled.
+    TReadsQueue & queueWrite = me.options.isDiscardFile ? written : recycled;
+    setReaderWriterCount(recycled, 1, 1);
+    setReaderWriterCount(loaded, 1, 1);
+    setReaderWriterCount(trimmed, 1, 1);
+    if (me.options.isDiscardFile)
+    {
+        setReaderWriterCount(written, 1, 1);
+    }
+
+    std::atomic<bool> aborted(false);
+    std::exception_ptr errorLoad, errorTrim, errorWrite, errorDiscard;
+
+    shareThreads(me);
+    StageThreads const & threads = me.threads;
+
+    std::thread threadLoad([&]()
+    {
+        setInputThreads(me, pinStageThread(me, threads.trim, threads.load));
+        unsigned batch = 1;
+        runStage(recycled, loaded, aborted, errorLoad, [&](TReads & reads)
+        {
+            me.options.logger->debug("Batch : {}", batch++);
+            me.options.logger->debug("\tLoad");
+            clearReads(me, reads);
+            stageLoad(me, reads);
+            placeReads(me, reads);
+            return !empty(reads);
+        });
+    });
+    std::thread threadWrite([&]()
+    {
+        setOutputThreads(me, pinStageThread(me,
+            threads.trim + threads.load, threads.write));
+        runStage(trimmed, queueWrite, aborted, errorWrite, [&](TReads & reads)
+        {
+            me.options.logger->debug("\tWrite");
+            writeReads(me, reads);
+            return true;
+        });
+    });
+    std::thread threadDiscard;
+    if (me.options.isDiscardFile)
+    {
+        threadDiscard = std::thread([&]()
+        {
+            setThreads(me.readsBlockDiscard, pinStageThread(me,
+                threads.trim + threads.load + threads.write,
+                threads.discard));
+            runStage(written, recycled, aborted, errorDiscard,
+            [&](TReads & reads)
+            {
+                me.options.logger->debug("\tWrite discard");
+                writeReadsDiscard(me, reads);
+                return true;
+            });
+        });
+    }
+
+    // Trimming keeps the OpenMP threads of the main thread, the first ones
+    // of its team pinned to the first slots.
+    omp_set_num_threads(threads.trim);
+    runStage(loaded, trimmed, aborted, errorTrim, [&](TReads & reads)
+    {
+        stageTrim(me, reads);
+        return true;
+    });
+
+    threadLoad.join();
+    threadWrite.join();
+    if (threadDiscard.joinable())
+        threadDiscard.join();
+
+    for (std::exception_ptr error : {errorLoad, errorTrim, errorWrite,
+        errorDiscard})
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+template <typename TSpec, typename TConfig>
+inline void runTrimming(Trimming<TSpec, TConfig> & me)
+{
+    me.options.logger->trace("Start timer");
+    start(me.timer);
+
+    // Configure threads.
+    me.options.logger->trace("Configure threading with OpenMP");
+    configureThreads(me);
+
+    // Open.
+    me.options.logger->info("Open files Input");
+    openInputFile(me);
+    seekInputFile(me);
+    me.options.logger->trace("Open files Output");
+    openOutputFile(me);
+    if (me.options.isDiscardFile)
+    {
+        openDiscardFile(me);
+    }
+
+    // Process reads in blocks.
+    runTrimming(me, typename TConfig::TThreading());
 
     // Close files.
     me.options.logger->debug("\tClose files");
@@ -0,0 +1,882 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Kernels of the trimmers, vectorized for the CPU found at run time
+// ============================================================================
+#ifndef APP_HMNTRIMMER_KERNELS_H_
+#define APP_HMNTRIMMER_KERNELS_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HMNTRIMMER_X86 1
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/basic.h>
+
+using namespace seqan;
+
+// ============================================================================
+// Tags, Classes, Enums
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Enum SimdLevel
+// ----------------------------------------------------------------------------
+
+// Instruction sets the kernels are written for, from the least to the most
+// capable.  The 128-bit kernels need SSE2 only, which every x86-64 CPU has.
+enum class SimdLevel : unsigned
+{
+    Scalar,
+    Sse2,
+    Avx2,
+    Avx512
+};
+
+// ----------------------------------------------------------------------------
+// Tags SimdScalar, SimdSse2, SimdAvx2, SimdAvx512
+// ----------------------------------------------------------------------------
+
+struct SimdScalar_;
+typedef Tag<SimdScalar_>            SimdScalar;
+
+struct SimdSse2_;
+typedef Tag<SimdSse2_>              SimdSse2;
+
+struct SimdAvx2_;
+typedef Tag<SimdAvx2_>              SimdAvx2;
+
+struct SimdAvx512_;
+typedef Tag<SimdAvx512_>            SimdAvx512;
+
+// ----------------------------------------------------------------------------
+// Class SimdKernels
+// ----------------------------------------------------------------------------
+
+// The kernels bound to the best implementation of the CPU.
+struct SimdKernels
+{
+    typedef void (*TQualityMasks)(uint64_t *, unsigned char const *,
+        std::size_t, unsigned char);
+    typedef std::size_t (*TWindowCut)(unsigned char const *, std::size_t,
+        unsigned, int);
+    typedef std::size_t (*TCountN)(unsigned char const *, std::size_t);
+    typedef void (*TEncodeBases)(unsigned char *, char const *, char const *,
+        std::size_t);
+
+    SimdLevel       level;
+    TQualityMasks   qualityMasks;
+    TWindowCut      windowCut;
+    TCountN         countN;
+    TEncodeBases    encodeBases;
+
+    SimdKernels() :
+        level(SimdLevel::Scalar),
+        qualityMasks(NULL),
+        windowCut(NULL),
+        countN(NULL),
+        encodeBases(NULL)
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function cpuSimdLevel()
+// ----------------------------------------------------------------------------
+
+// Most capable level the CPU and the OS support.
+inline SimdLevel cpuSimdLevel()
+{
+#ifdef HMNTRIMMER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+        return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::Avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return SimdLevel::Sse2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// ----------------------------------------------------------------------------
+// Function simdLevelName()
+// ----------------------------------------------------------------------------
+
+inline char const * simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::Sse2: return "sse2";
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function qualityMasks()
+// ----------------------------------------------------------------------------
+
+// Bit j of masks[k] is set when the byte 64 * k + j of the values of Dna5Q,
+// base | quality << 2 or 252 for N, is low: at most threshold, or an N.  The
+// bits after size are cleared.
+inline uint64_t
+_qualityMask(unsigned char const * values, std::size_t size,
+unsigned char threshold)
+{
+    uint64_t mask = 0;
+    for (std::size_t j = 0; j < size; ++j)
+        if (values[j] <= threshold || values[j] == 252)
+            mask |= uint64_t(1) << j;
+    return mask;
+}
+
+inline void
+qualityMasks(uint64_t * masks, unsigned char const * values, std::size_t size,
+unsigned char threshold, SimdScalar)
+{
+    for (std::size_t block = 0; block < size; block += 64)
+        *masks++ = _qualityMask(values + block,
+            std::min<std::size_t>(64, size - block), threshold);
+}
+
+#ifdef HMNTRIMMER_X86
+__attribute__((target("sse2")))
+inline void
+qualityMasks(uint64_t * masks, unsigned char const * values, std::size_t size,
+unsigned char threshold, SimdSse2)
+{
+    __m128i const high = _mm_set1_epi8(char(threshold));
+    __m128i const n = _mm_set1_epi8(char(252));
+    std::size_t block = 0;
+    for (; size - block >= 64; block += 64)
+    {
+        uint64_t mask = 0;
+        for (unsigned j = 0; j < 64; j += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(
+                reinterpret_cast<__m128i const *>(values + block + j));
+            __m128i low = _mm_or_si128(
+                _mm_cmpeq_epi8(_mm_min_epu8(bytes, high), bytes),
+                _mm_cmpeq_epi8(bytes, n));
+            mask |= uint64_t(unsigned(_mm_movemask_epi8(low))) << j;
+        }
+        *masks++ = mask;
+    }
+    if (block < size)
+        *masks = _qualityMask(values + block, size - block, threshold);
+}
+
+__attribute__((target("avx2")))
+inline void
+qualityMasks(uint64_t * masks, unsigned char const * values, std::size_t size,
+unsigned char threshold, SimdAvx2)
+{
+    __m256i const high = _mm256_set1_epi8(char(threshold));
+    __m256i const n = _mm256_set1_epi8(char(252));
+    std::size_t block = 0;
+    for (; size - block >= 64; block += 64)
+    {
+        uint64_t mask = 0;
+        for (unsigned j = 0; j < 64; j += 32)
+        {
+            __m256i bytes = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const *>(values + block + j));
+            __m256i low = _mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, high), bytes),
+                _mm256_cmpeq_epi8(bytes, n));
+            mask |= uint64_t(unsigned(_mm256_movemask_epi8(low))) << j;
+        }
+        *masks++ = mask;
+    }
+    if (block < size)
+        *masks = _qualityMask(values + block, size - block, threshold);
+}
+
+__attribute__((target("avx512bw")))
+inline void
+qualityMasks(uint64_t * masks, unsigned char const * values, std::size_t size,
+unsigned char threshold, SimdAvx512)
+{
+    __m512i const high = _mm512_set1_epi8(char(threshold));
+    __m512i const n = _mm512_set1_epi8(char(252));
+    std::size_t block = 0;
+    for (; size - block >= 64; block += 64)
+    {
+        __m512i bytes = _mm512_loadu_si512(values + block);
+        *masks++ = _mm512_cmple_epu8_mask(bytes, high) |
+            _mm512_cmpeq_epi8_mask(bytes, n);
+    }
+    if (block < size)
+        *masks = _qualityMask(values + block, size - block, threshold);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Function windowCut()
+// ----------------------------------------------------------------------------
+
+inline int _quality(unsigned char value)
+{
+    return value == 252 ? 0 : value >> 2;
+}
+
+// Sums of windows are compared with mean * window, clamped to what a sum of
+// qualities reaches so that the vectorized kernels compare 32-bit lanes.
+inline int _windowThreshold(int mean, unsigned window)
+{
+    int64_t threshold = int64_t(mean) * window;
+    return int(std::max<int64_t>(0, std::min<int64_t>(threshold,
+        int64_t(62) * window + 1)));
+}
+
+// The window at start is below the mean, crop back the bases of quality
+// below the mean before it, to the last one of the mean, lastGood, keeping
+// one base at least.  Returns the length to keep.
+inline std::size_t
+_cropWindow(unsigned char const * values, std::size_t start,
+std::size_t lastGood, int mean)
+{
+    if (start <= 1 || _quality(values[start]) >= mean)
+        return start;
+    return std::max<std::size_t>(1, lastGood) + 1;
+}
+
+// Go on from the window at start, of quality sum, with lastGood the last
+// base of the mean before it.
+inline std::size_t
+_windowCutFrom(unsigned char const * values, std::size_t size,
+unsigned window, int threshold, int mean, std::size_t start, int64_t sum,
+std::size_t lastGood)
+{
+    for (;; ++start)
+    {
+        if (sum < threshold)
+            return _cropWindow(values, start, lastGood, mean);
+        if (start + window >= size)
+            return size;
+        sum += _quality(values[start + window]) - _quality(values[start]);
+        if (_quality(values[start]) >= mean)
+            lastGood = start;
+    }
+}
+
+inline int64_t _windowSum(unsigned char const * values, unsigned window)
+{
+    int64_t sum = 0;
+    for (unsigned j = 0; j < window; ++j)
+        sum += _quality(values[j]);
+    return sum;
+}
+
+// Length to keep before the first window of size values of Dna5Q whose mean
+// quality is below mean, cropped back while the bases are below the mean,
+// size when there is none.  Window sums are integers compared with
+// mean * window, which gives the same windows as the division of floats.
+// Windows at start + 1 to start + lanes are the sum at start plus the
+// inclusive prefix sums of quality[j + window] - quality[j], computed in
+// the lanes of a vector; the bases of the mean are found in the same pass.
+inline std::size_t
+windowCut(unsigned char const * values, std::size_t size, unsigned window,
+int mean, SimdScalar)
+{
+    if (window == 0 || size < window)
+        return size;
+    return _windowCutFrom(values, size, window, _windowThreshold(mean,
+        window), mean, 0, _windowSum(values, window), 0);
+}
+
+#ifdef HMNTRIMMER_X86
+__attribute__((target("sse2")))
+inline __m128i _qualities(__m128i values)
+{
+    __m128i qualities = _mm_srli_epi32(values, 2);
+    return _mm_andnot_si128(_mm_cmpeq_epi32(qualities, _mm_set1_epi32(63)),
+        qualities);
+}
+
+__attribute__((target("sse2")))
+inline std::size_t
+windowCut(unsigned char const * values, std::size_t size, unsigned window,
+int mean, SimdSse2)
+{
+    if (window == 0 || size < window || window > (1u << 24))
+        return windowCut(values, size, window, mean, SimdScalar());
+    int threshold = _windowThreshold(mean, window);
+    int64_t sum = _windowSum(values, window);
+    if (sum < threshold)
+        return _cropWindow(values, 0, 0, mean);
+
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const high = _mm_set1_epi32(threshold);
+    __m128i const low = _mm_set1_epi32(std::max(-1, std::min(mean, 63) - 1));
+    __m128i sums = _mm_set1_epi32(int(sum));
+    std::size_t lastGood = 0;
+    std::size_t last = size - window;
+    std::size_t start = 0;
+    for (; last - start >= 4; start += 4)
+    {
+        int first, next;
+        std::memcpy(&first, values + start, 4);
+        std::memcpy(&next, values + start + window, 4);
+        __m128i quality = _qualities(_mm_unpacklo_epi16(_mm_unpacklo_epi8(
+            _mm_cvtsi32_si128(first), zero), zero));
+        __m128i diffs = _mm_sub_epi32(_qualities(_mm_unpacklo_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(next), zero), zero)), quality);
+        diffs = _mm_add_epi32(diffs, _mm_slli_si128(diffs, 4));
+        diffs = _mm_add_epi32(diffs, _mm_slli_si128(diffs, 8));
+        sums = _mm_add_epi32(_mm_shuffle_epi32(sums, 0xff), diffs);
+
+        unsigned hits = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpgt_epi32(high, sums)));
+        unsigned goods = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpgt_epi32(quality, low)));
+        if (hits != 0)
+        {
+            unsigned lane = __builtin_ctz(hits);
+            goods &= (2u << lane) - 1;
+            if (goods != 0)
+                lastGood = start + 31 - __builtin_clz(goods);
+            return _cropWindow(values, start + lane + 1, lastGood, mean);
+        }
+        if (goods != 0)
+            lastGood = start + 31 - __builtin_clz(goods);
+    }
+    return _windowCutFrom(values, size, window, threshold, mean, start,
+        _mm_cvtsi128_si32(_mm_shuffle_epi32(sums, 0xff)), lastGood);
+}
+
+__attribute__((target("avx2")))
+inline __m256i _qualities(__m256i values)
+{
+    __m256i qualities = _mm256_srli_epi32(values, 2);
+    return _mm256_andnot_si256(_mm256_cmpeq_epi32(qualities,
+        _mm256_set1_epi32(63)), qualities);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t
+windowCut(unsigned char const * values, std::size_t size, unsigned window,
+int mean, SimdAvx2)
+{
+    if (window == 0 || size < window || window > (1u << 24))
+        return windowCut(values, size, window, mean, SimdScalar());
+    int threshold = _windowThreshold(mean, window);
+    int64_t sum = _windowSum(values, window);
+    if (sum < threshold)
+        return _cropWindow(values, 0, 0, mean);
+
+    __m256i const high = _mm256_set1_epi32(threshold);
+    __m256i const low = _mm256_set1_epi32(std::max(-1, std::min(mean, 63) -
+        1));
+    __m256i const lastLane = _mm256_set1_epi32(7);
+    __m256i sums = _mm256_set1_epi32(int(sum));
+    std::size_t lastGood = 0;
+    std::size_t last = size - window;
+    std::size_t start = 0;
+    for (; last - start >= 8; start += 8)
+    {
+        __m256i quality = _qualities(_mm256_cvtepu8_epi32(_mm_loadl_epi64(
+            reinterpret_cast<__m128i const *>(values + start))));
+        __m256i diffs = _mm256_sub_epi32(_qualities(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<__m128i const *>(values + start +
+            window)))), quality);
+        diffs = _mm256_add_epi32(diffs, _mm256_slli_si256(diffs, 4));
+        diffs = _mm256_add_epi32(diffs, _mm256_slli_si256(diffs, 8));
+        __m256i half = _mm256_shuffle_epi32(diffs, 0xff);
+        diffs = _mm256_add_epi32(diffs, _mm256_permute2x128_si256(half, half,
+            0x08));
+        sums = _mm256_add_epi32(_mm256_permutevar8x32_epi32(sums, lastLane),
+            diffs);
+
+        unsigned hits = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(high, sums)));
+        unsigned goods = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(quality, low)));
+        if (hits != 0)
+        {
+            unsigned lane = __builtin_ctz(hits);
+            goods &= (2u << lane) - 1;
+            if (goods != 0)
+                lastGood = start + 31 - __builtin_clz(goods);
+            return _cropWindow(values, start + lane + 1, lastGood, mean);
+        }
+        if (goods != 0)
+            lastGood = start + 31 - __builtin_clz(goods);
+    }
+    return _windowCutFrom(values, size, window, threshold, mean, start,
+        _mm256_extract_epi32(sums, 7), lastGood);
+}
+
+__attribute__((target("avx512bw")))
+inline std::size_t
+windowCut(unsigned char const * values, std::size_t size, unsigned window,
+int mean, SimdAvx512)
+{
+    if (window == 0 || size < window || window > (1u << 24))
+        return windowCut(values, size, window, mean, SimdScalar());
+    int threshold = _windowThreshold(mean, window);
+    int64_t sum = _windowSum(values, window);
+    if (sum < threshold)
+        return _cropWindow(values, 0, 0, mean);
+
+    __m512i const zero = _mm512_setzero_si512();
+    __m512i const n = _mm512_set1_epi32(63);
+    __m512i const high = _mm512_set1_epi32(threshold);
+    __m512i const low = _mm512_set1_epi32(mean);
+    __m512i const lastLane = _mm512_set1_epi32(15);
+    __m512i sums = _mm512_set1_epi32(int(sum));
+    std::size_t lastGood = 0;
+    std::size_t last = size - window;
+    std::size_t start = 0;
+    for (; last - start >= 16; start += 16)
+    {
+        __m128i const * first = reinterpret_cast<__m128i const *>(values +
+            start);
+        __m128i const * next = reinterpret_cast<__m128i const *>(values +
+            start + window);
+        __m512i quality = _mm512_maskz_srli_epi32(0xffff,
+            _mm512_maskz_cvtepu8_epi32(0xffff, _mm_loadu_si128(first)), 2);
+        quality = _mm512_mask_mov_epi32(quality,
+            _mm512_cmpeq_epi32_mask(quality, n), zero);
+        __m512i qualityNext = _mm512_maskz_srli_epi32(0xffff,
+            _mm512_maskz_cvtepu8_epi32(0xffff, _mm_loadu_si128(next)), 2);
+        qualityNext = _mm512_mask_mov_epi32(qualityNext,
+            _mm512_cmpeq_epi32_mask(qualityNext, n), zero);
+        __m512i diffs = _mm512_sub_epi32(qualityNext, quality);
+        diffs = _mm512_add_epi32(diffs, _mm512_maskz_alignr_epi32(0xffff,
+            diffs, zero, 15));
+        diffs = _mm512_add_epi32(diffs, _mm512_maskz_alignr_epi32(0xffff,
+            diffs, zero, 14));
+        diffs = _mm512_add_epi32(diffs, _mm512_maskz_alignr_epi32(0xffff,
+            diffs, zero, 12));
+        diffs = _mm512_add_epi32(diffs, _mm512_maskz_alignr_epi32(0xffff,
+            diffs, zero, 8));
+        sums = _mm512_add_epi32(_mm512_maskz_permutexvar_epi32(0xffff,
+            lastLane, sums), diffs);
+
+        unsigned hits = _mm512_cmplt_epi32_mask(sums, high);
+        unsigned goods = _mm512_cmpge_epi32_mask(quality, low);
+        if (hits != 0)
+        {
+            unsigned lane = __builtin_ctz(hits);
+            goods &= (2u << lane) - 1;
+            if (goods != 0)
+                lastGood = start + 31 - __builtin_clz(goods);
+            return _cropWindow(values, start + lane + 1, lastGood, mean);
+        }
+        if (goods != 0)
+            lastGood = start + 31 - __builtin_clz(goods);
+    }
+    int lanes[16];
+    _mm512_storeu_si512(lanes, sums);
+    return _windowCutFrom(values, size, window, threshold, mean, start,
+        lanes[15], lastGood);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Function countN()
+// ----------------------------------------------------------------------------
+
+// Number of N, bytes 252, among the size values of Dna5Q.  Bytes are compared
+// by 8 in a word xored with N: a byte is zero when its high bit is set neither
+// in it nor in its 7 low bits plus 0x7f.  The high bits found are summed by a
+// multiplication, without popcount.
+inline std::size_t
+countN(unsigned char const * values, std::size_t size, SimdScalar)
+{
+    uint64_t const low = 0x7f7f7f7f7f7f7f7full;
+    std::size_t count = 0;
+    std::size_t j = 0;
+    for (; size - j >= 8; j += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, values + j, 8);
+        word ^= 0xfcfcfcfcfcfcfcfcull;
+        uint64_t zeros = ~(((word & low) + low) | word | low);
+        count += ((zeros >> 7) * 0x0101010101010101ull) >> 56;
+    }
+    for (; j < size; ++j)
+        count += values[j] == 252;
+    return count;
+}
+
+#ifdef HMNTRIMMER_X86
+// Matches are counted down in bytes by 255 vectors at most, then summed by
+// psadbw, SSE2 having no popcount.
+__attribute__((target("sse2")))
+inline std::size_t
+countN(unsigned char const * values, std::size_t size, SimdSse2)
+{
+    __m128i const n = _mm_set1_epi8(char(252));
+    __m128i const zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    std::size_t block = 0;
+    while (size - block >= 16)
+    {
+        std::size_t end = block + 16 * std::min<std::size_t>(255,
+            (size - block) / 16);
+        __m128i counts = zero;
+        for (; block < end; block += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(
+                reinterpret_cast<__m128i const *>(values + block));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(bytes, n));
+        }
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(counts, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+    return lanes[0] + lanes[1] +
+        countN(values + block, size - block, SimdScalar());
+}
+
+__attribute__((target("avx2,popcnt")))
+inline std::size_t
+countN(unsigned char const * values, std::size_t size, SimdAvx2)
+{
+    __m256i const n = _mm256_set1_epi8(char(252));
+    std::size_t count = 0;
+    std::size_t block = 0;
+    for (; size - block >= 32; block += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(values + block));
+        count += __builtin_popcount(unsigned(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, n))));
+    }
+    if (size - block >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(values + block));
+        count += __builtin_popcount(unsigned(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(bytes, _mm256_castsi256_si128(n)))));
+        block += 16;
+    }
+    return count + countN(values + block, size - block, SimdScalar());
+}
+
+__attribute__((target("avx512bw,popcnt")))
+inline std::size_t
+countN(unsigned char const * values, std::size_t size, SimdAvx512)
+{
+    __m512i const n = _mm512_set1_epi8(char(252));
+    std::size_t count = 0;
+    std::size_t block = 0;
+    for (; size - block >= 64; block += 64)
+        count += __builtin_popcountll(_mm512_cmpeq_epi8_mask(
+            _mm512_loadu_si512(values + block), n));
+    if (block < size)
+    {
+        // Masked load of the last bytes, not read past size.
+        __mmask64 tail = ~uint64_t(0) >> (64 - (size - block));
+        count += __builtin_popcountll(_mm512_mask_cmpeq_epi8_mask(tail,
+            _mm512_maskz_loadu_epi8(tail, values + block), n));
+    }
+    return count;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Function encodeBases()
+// ----------------------------------------------------------------------------
+
+// Encode size bases of a FASTQ record with their qualities, Phred+33, to the
+// values of Dna5Q as its constructor and assignQualityValue() do: A, C, G,
+// T or U in any case to 0..3, any other letter to N, 252, qualities clamped
+// to 0..62 and dropped on N.
+inline void
+encodeBases(unsigned char * out, char const * seq, char const * qual,
+std::size_t size, SimdScalar)
+{
+    for (std::size_t j = 0; j < size; ++j)
+    {
+        unsigned char base = TranslateTableCharToDna5_<>::VALUE[
+            static_cast<unsigned char>(seq[j])];
+        int quality = std::max(0, std::min(int(qual[j]) - '!', 62));
+        out[j] = base == 4 ? 252 : base | quality << 2;
+    }
+}
+
+#ifdef HMNTRIMMER_X86
+// Bases are upper cased by clearing bit 5, qualities of the bytes above 127,
+// negative chars, are 0.  Qualities stay below 64 so that shifting 16-bit
+// lanes does not carry between bytes.
+__attribute__((target("sse2")))
+inline void
+encodeBases(unsigned char * out, char const * seq, char const * qual,
+std::size_t size, SimdSse2)
+{
+    __m128i const upper = _mm_set1_epi8(char(0xdf));
+    __m128i const zero = _mm_setzero_si128();
+    std::size_t block = 0;
+    for (; size - block >= 16; block += 16)
+    {
+        __m128i bases = _mm_and_si128(upper, _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(seq + block)));
+        __m128i a = _mm_cmpeq_epi8(bases, _mm_set1_epi8('A'));
+        __m128i c = _mm_cmpeq_epi8(bases, _mm_set1_epi8('C'));
+        __m128i g = _mm_cmpeq_epi8(bases, _mm_set1_epi8('G'));
+        __m128i t = _mm_or_si128(_mm_cmpeq_epi8(bases, _mm_set1_epi8('T')),
+            _mm_cmpeq_epi8(bases, _mm_set1_epi8('U')));
+        __m128i codes = _mm_or_si128(
+            _mm_and_si128(_mm_or_si128(c, t), _mm_set1_epi8(1)),
+            _mm_and_si128(_mm_or_si128(g, t), _mm_set1_epi8(2)));
+        __m128i isBase = _mm_or_si128(_mm_or_si128(a, c), _mm_or_si128(g, t));
+
+        __m128i quals = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(qual + block));
+        quals = _mm_andnot_si128(_mm_cmplt_epi8(quals, zero), _mm_min_epu8(
+            _mm_subs_epu8(quals, _mm_set1_epi8('!')), _mm_set1_epi8(62)));
+
+        __m128i values = _mm_or_si128(codes, _mm_slli_epi16(quals, 2));
+        values = _mm_or_si128(_mm_and_si128(isBase, values),
+            _mm_andnot_si128(isBase, _mm_set1_epi8(char(252))));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + block), values);
+    }
+    encodeBases(out + block, seq + block, qual + block, size - block,
+        SimdScalar());
+}
+
+__attribute__((target("avx2")))
+inline void
+encodeBases(unsigned char * out, char const * seq, char const * qual,
+std::size_t size, SimdAvx2)
+{
+    __m256i const upper = _mm256_set1_epi8(char(0xdf));
+    __m256i const zero = _mm256_setzero_si256();
+    std::size_t block = 0;
+    for (; size - block >= 32; block += 32)
+    {
+        __m256i bases = _mm256_and_si256(upper, _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(seq + block)));
+        __m256i a = _mm256_cmpeq_epi8(bases, _mm256_set1_epi8('A'));
+        __m256i c = _mm256_cmpeq_epi8(bases, _mm256_set1_epi8('C'));
+        __m256i g = _mm256_cmpeq_epi8(bases, _mm256_set1_epi8('G'));
+        __m256i t = _mm256_or_si256(
+            _mm256_cmpeq_epi8(bases, _mm256_set1_epi8('T')),
+            _mm256_cmpeq_epi8(bases, _mm256_set1_epi8('U')));
+        __m256i codes = _mm256_or_si256(
+            _mm256_and_si256(_mm256_or_si256(c, t), _mm256_set1_epi8(1)),
+            _mm256_and_si256(_mm256_or_si256(g, t), _mm256_set1_epi8(2)));
+        __m256i isBase = _mm256_or_si256(_mm256_or_si256(a, c),
+            _mm256_or_si256(g, t));
+
+        __m256i quals = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(qual + block));
+        quals = _mm256_andnot_si256(_mm256_cmpgt_epi8(zero, quals),
+            _mm256_min_epu8(_mm256_subs_epu8(quals, _mm256_set1_epi8('!')),
+            _mm256_set1_epi8(62)));
+
+        __m256i values = _mm256_or_si256(codes, _mm256_slli_epi16(quals, 2));
+        values = _mm256_blendv_epi8(_mm256_set1_epi8(char(252)), values,
+            isBase);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + block), values);
+    }
+    encodeBases(out + block, seq + block, qual + block, size - block,
+        SimdSse2());
+}
+
+__attribute__((target("avx512bw")))
+inline void
+encodeBases(unsigned char * out, char const * seq, char const * qual,
+std::size_t size, SimdAvx512)
+{
+    __m512i const upper = _mm512_set1_epi8(char(0xdf));
+    __m512i const zero = _mm512_setzero_si512();
+    for (std::size_t block = 0; block < size; block += 64)
+    {
+        // All 64 bytes, or the last ones with masked loads and store.
+        __mmask64 mask = size - block >= 64 ? ~uint64_t(0) :
+            ~uint64_t(0) >> (64 - (size - block));
+        __m512i bases = _mm512_and_si512(upper,
+            _mm512_maskz_loadu_epi8(mask, seq + block));
+        __mmask64 a = _mm512_cmpeq_epi8_mask(bases, _mm512_set1_epi8('A'));
+        __mmask64 c = _mm512_cmpeq_epi8_mask(bases, _mm512_set1_epi8('C'));
+        __mmask64 g = _mm512_cmpeq_epi8_mask(bases, _mm512_set1_epi8('G'));
+        __mmask64 t = _mm512_cmpeq_epi8_mask(bases, _mm512_set1_epi8('T')) |
+            _mm512_cmpeq_epi8_mask(bases, _mm512_set1_epi8('U'));
+        __m512i codes = _mm512_or_si512(
+            _mm512_maskz_mov_epi8(c | t, _mm512_set1_epi8(1)),
+            _mm512_maskz_mov_epi8(g | t, _mm512_set1_epi8(2)));
+
+        __m512i quals = _mm512_maskz_loadu_epi8(mask, qual + block);
+        quals = _mm512_maskz_min_epu8(_mm512_cmpge_epi8_mask(quals, zero),
+            _mm512_subs_epu8(quals, _mm512_set1_epi8('!')),
+            _mm512_set1_epi8(62));
+
+        __m512i values = _mm512_mask_mov_epi8(_mm512_set1_epi8(char(252)),
+            a | c | g | t, _mm512_or_si512(codes, _mm512_slli_epi16(quals, 2)));
+        _mm512_mask_storeu_epi8(out + block, mask, values);
+    }
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Function bindKernels()
+// ----------------------------------------------------------------------------
+
+template <typename TSimd>
+inline void _qualityMasks(uint64_t * masks, unsigned char const * values,
+std::size_t size, unsigned char threshold)
+{
+    qualityMasks(masks, values, size, threshold, TSimd());
+}
+
+template <typename TSimd>
+inline std::size_t _windowCut(unsigned char const * values, std::size_t size,
+unsigned window, int mean)
+{
+    return windowCut(values, size, window, mean, TSimd());
+}
+
+template <typename TSimd>
+inline std::size_t _countN(unsigned char const * values, std::size_t size)
+{
+    return countN(values, size, TSimd());
+}
+
+template <typename TSimd>
+inline void _encodeBases(unsigned char * out, char const * seq,
+char const * qual, std::size_t size)
+{
+    encodeBases(out, seq, qual, size, TSimd());
+}
+
+template <typename TSimd>
+inline void _bindKernels(SimdKernels & me, TSimd)
+{
+    me.qualityMasks = &_qualityMasks<TSimd>;
+    me.windowCut = &_windowCut<TSimd>;
+    me.countN = &_countN<TSimd>;
+    me.encodeBases = &_encodeBases<TSimd>;
+}
+
+// Bind the kernels of the level, or of the best one below it which is built.
+inline void bindKernels(SimdKernels & me, SimdLevel level)
+{
+    me.level = level;
+    switch (level)
+    {
+#ifdef HMNTRIMMER_X86
+        case SimdLevel::Avx512:
+            return _bindKernels(me, SimdAvx512());
+        case SimdLevel::Avx2:
+            return _bindKernels(me, SimdAvx2());
+        case SimdLevel::Sse2:
+            return _bindKernels(me, SimdSse2());
+#endif
+        default:
+            me.level = SimdLevel::Scalar;
+            return _bindKernels(me, SimdScalar());
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function simdKernels()
+// ----------------------------------------------------------------------------
+
+// The kernels of the CPU, bound at the first call.  They are bound again to
+// another level by bindKernels(), before any thread uses them.
+inline SimdKernels & simdKernels()
+{
+    static SimdKernels kernels = []()
+    {
+        SimdKernels kernels;
+        bindKernels(kernels, cpuSimdLevel());
+        return kernels;
+    }();
+    return kernels;
+}
+
+// ----------------------------------------------------------------------------
+// Function findQualityRun()
+// ----------------------------------------------------------------------------
+
+// Position of the first run of count bases of quality at most quality among
+// the size values of Dna5Q, size when there is none.  Masks are made by
+// slices of 512 bases, the search stops at the first run found.  A run
+// crossing masks is carried as its length.
+inline std::size_t
+findQualityRun(unsigned char const * values, std::size_t size, int quality,
+std::size_t count)
+{
+    if (count == 0)
+        return 0;
+    if (quality < 0)
+        return size;
+    unsigned char threshold = std::min(4 * std::min(quality, 63) + 3, 255);
+
+    uint64_t masks[8];
+    std::size_t run = 0;
+    for (std::size_t slice = 0; slice < size; slice += 512)
+    {
+        std::size_t sliceSize = std::min<std::size_t>(512, size - slice);
+        simdKernels().qualityMasks(masks, values + slice, sliceSize, threshold);
+        for (std::size_t k = 0; k * 64 < sliceSize; ++k)
+        {
+            uint64_t mask = masks[k];
+            std::size_t block = slice + k * 64;
+            unsigned pos = 0;
+
+            // Low bases continuing the run of the masks before.
+            if (run > 0)
+            {
+                unsigned ones = ~mask ? __builtin_ctzll(~mask) : 64;
+                if (run + ones >= count)
+                    return block - run;
+                if (ones == 64)
+                {
+                    run += 64;
+                    continue;
+                }
+                run = 0;
+                pos = ones;
+            }
+
+            // Runs inside the mask, the last one may go on in the next.
+            while (pos < 64 && (mask >> pos) != 0)
+            {
+                pos += __builtin_ctzll(mask >> pos);
+                uint64_t rest = ~(mask >> pos);
+                unsigned ones = rest ? __builtin_ctzll(rest) : 64;
+                if (ones >= count)
+                    return block + pos;
+                if (pos + ones == 64)
+                {
+                    run = ones;
+                    break;
+                }
+                pos += ones;
+            }
+        }
+    }
+    return size;
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_KERNELS_H_
@@ -66,8 +66,8 @@ typedef Tag<SequencingPaired_>      SequencingPaired;
 // Tags SeqStore
 // ----------------------------------------------------------------------------
 
-struct SeqStoreIdent_;
-typedef Tag<SeqStoreIdent_>         SeqStoreIdent;
+struct SeqStoreDiscard_;
+typedef Tag<SeqStoreDiscard_>       SeqStoreDiscard;
 
 struct SeqStoreRemove_;
 typedef Tag<SeqStoreRemove_>        SeqStoreRemove;
@@ -18,22 +18,30 @@
 // STL headers
 // ----------------------------------------------------------------------------
 
+#include <cstdint>
 #include <iostream>
 #include <math.h>
-#include <set>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 // ----------------------------------------------------------------------------
 // SeqAn headers
 // ----------------------------------------------------------------------------
 
-#include <seqan/alignment_free.h> 
-#include <seqan/misc/accumulators.h> 
+#include <seqan/parallel.h>
 #include <seqan/seq_io.h>
 
 // ----------------------------------------------------------------------------
 // App headers
 // ----------------------------------------------------------------------------
 
+#include "fastq_map.hpp"
+#include "gzip_in.hpp"
+#include "kernels.hpp"
+#include "zstd_in.hpp"
+#include "block_out.hpp"
 #include "misc_tags.hpp"
 #include "trimmers.hpp"
 
@@ -54,8 +62,10 @@ struct SeqConfig
     typedef Dna5Q               TAlphabetSequence;
     typedef Alloc<>             TSeqSpec;
 
-    typedef Owner<>             TSeqsNameSpec;
-    typedef Owner<>             TSeqsSpec;
+    // Names and sequences of a batch are each one arena, cleared without
+    // releasing its memory between batches.
+    typedef Owner<ConcatDirect<> >  TSeqsNameSpec;
+    typedef Owner<ConcatDirect<> >  TSeqsSpec;
 
     typedef typename TRunConfig::TThreading         TThreading;
     typedef typename TRunConfig::TSequencing        TSequencing;
@@ -89,14 +99,12 @@ struct SeqStore
     typedef String<TAlphabetSequence, TSeqSpec>             TSeq;
     typedef StringSet<TSeq, TSeqsSpec>                      TSeqs;
 
-    // Idents.
-    typedef typename Iterator<TSeqs const, Standard>::Type  TSeqsIt;
-    typedef typename Size<TSeqs>::Type                      TReadId;
-    typedef typename Value<TSeqs const>::Type               TSeqsValue;
-    typedef typename Size<TSeqsValue>::Type                 TSize;
-    typedef typename Id<TSeqs>::Type                        TId;
+    // Discarded reads, one flag per read (or pair) of the batch.
+    typedef String<unsigned char>                           TDiscards;
 
-    typedef std::set<TId>                                   TIdents;
+    // Kept window [begin, end) of each read, narrowed by the trimmers.
+    typedef Pair<unsigned>                                  TWindow;
+    typedef String<TWindow>                                 TWindows;
 
     typedef Triple<TSeqName>                                TPName;
     typedef Triple<TSeqs>                                   TPSeqs;
@@ -107,14 +115,16 @@ struct SeqStore
     TPName      namesRemove;
     TPSeqs      seqsRemove;
 
-    TIdents     idents;
+    TDiscards   discards;
+    Pair<TWindows>  windows;
 
     SeqStore() :
         names(),
         seqs(),
         namesRemove(),
         seqsRemove(),
-        idents()
+        discards(),
+        windows()
     {}
 };
 
@@ -123,329 +133,368 @@ struct SeqStore
 // ============================================================================
 
 // ----------------------------------------------------------------------------
-// Function trimPrefix()
+// Function adviseHugePages()
 // ----------------------------------------------------------------------------
 
-template <typename TString, typename TValue>
-inline typename Prefix<TString const>::Type
-trimPrefix(TString const & string, TValue const & pos)
+// Ask for transparent huge pages on the whole huge pages of an arena, large
+// batches then need far fewer TLB entries.
+template <typename TValue, typename TSpec>
+inline void adviseHugePages(String<TValue, Alloc<TSpec> > & arena)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    std::uintptr_t const hugePage = 2ul << 20;
+    std::uintptr_t first =
+        reinterpret_cast<std::uintptr_t>(begin(arena, Standard()));
+    std::uintptr_t last = first + capacity(arena) * sizeof(TValue);
+    first = (first + hugePage - 1) & ~(hugePage - 1);
+    last &= ~(hugePage - 1);
+    if (first < last)
+        madvise(reinterpret_cast<void *>(first), last - first, MADV_HUGEPAGE);
+#else
+    ignoreUnusedVariableWarning(arena);
+#endif
+}
+
+template <typename TString, typename TSpec>
+inline void
+adviseHugePages(StringSet<TString, Owner<ConcatDirect<TSpec> > > & set)
+{
+    adviseHugePages(set.concat);
+}
+
+template <typename TValue>
+inline void adviseHugePages(Triple<TValue> & triple)
 {
-    return prefix(string, pos);
+    adviseHugePages(triple.i1);
+    adviseHugePages(triple.i2);
+    adviseHugePages(triple.i3);
 }
 
 // ----------------------------------------------------------------------------
-// Function update()
+// Function trimWindow()
 // ----------------------------------------------------------------------------
 
-template <typename TContainer, typename TIdents>
-inline void update(TContainer & c, TIdents & idents)
+// Keep the first len bases of the current window.
+template <typename TWindow, typename TSize>
+inline void trimWindow(TWindow & window, TSize const & len)
 {
-    // Adapted from https://codereview.stackexchange.com - 206686
-    auto it = std::begin(idents);
-    unsigned current_index = 0;
-
-    assert(std::is_sorted(it, std::end(idents)));
-    typedef typename Value<TContainer const>::Type    TContainerValue;
-    typename Iterator<TContainer, Standard>::Type newEnd = std::remove_if(
-            begin(c, Standard()), 
-            end(c, Standard()), 
-            [&](TContainerValue const &){
-            if (it == std::end(idents)) { return false; }
-            if (*it == current_index++) { return ++it, true; }
-            else {return false;}}
-    );
-    resize(c, position(newEnd, c) , Exact());
+    window.i2 = window.i1 + len;
 }
 
-template <typename TSpec, typename TConfig>
-inline void update(SeqStore<TSpec, TConfig> & me)
+// ----------------------------------------------------------------------------
+// Function initWindows()
+// ----------------------------------------------------------------------------
+
+template <typename TWindows, typename TSeqs>
+inline void initWindows(TWindows & windows, TSeqs const & seqs)
 {
-    SEQAN_OMP_PRAGMA(parallel sections)
+    typedef typename Size<TSeqs>::Type      TSize;
+    typedef typename Value<TWindows>::Type  TWindow;
+
+    resize(windows, length(seqs), Exact());
+    for (TSize pos = 0; pos < length(seqs); ++pos)
     {
-        SEQAN_OMP_PRAGMA(section)
-        {    
-            update(me.names.i1, me.idents);
-        }
-        SEQAN_OMP_PRAGMA(section)
-        {
-            update(me.seqs.i1, me.idents);
-        }
+        windows[pos] = TWindow(0, length(seqs[pos]));
     }
+}
 
+template <typename TSpec, typename TConfig>
+inline void initWindows(SeqStore<TSpec, TConfig> & me)
+{
+    initWindows(me.windows.i1, me.seqs.i1);
     if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
     {
-        SEQAN_OMP_PRAGMA(parallel sections)
-        {
-            SEQAN_OMP_PRAGMA(section)
-            {    
-                update(me.names.i2, me.idents);
-            }
-            SEQAN_OMP_PRAGMA(section)
-            {
-                update(me.seqs.i2, me.idents);
-            }
-        }
+        initWindows(me.windows.i2, me.seqs.i2);
     }
 }
 
 // ----------------------------------------------------------------------------
-// Function updateDiscard()
+// Function discardRead()
 // ----------------------------------------------------------------------------
 
-template <typename TContainer, typename TIdents>
-inline void
-updateDiscard(TContainer & origin, TContainer & incoming, TIdents & idents)
+// Flag a read as discarded. Each read, or pair, owns its flag and is trimmed
+// by one thread only, so no lock is needed.
+template <typename TDiscards, typename TPos>
+inline void discardRead(TDiscards & discards, TPos const & pos)
 {
-    typedef typename TIdents::const_iterator TIdentIt;
-    for (TIdentIt itIdent = idents.begin(); itIdent != idents.end(); ++ itIdent)
-    {
-            appendValue(incoming, origin[*itIdent]);
-    }
+    discards[pos] = 1;
 }
 
+// ----------------------------------------------------------------------------
+// Function isDiscarded()
+// ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig>
-inline void updateDiscard(SeqStore<TSpec, TConfig> & me)
+template <typename TDiscards, typename TPos>
+inline bool isDiscarded(TDiscards const & discards, TPos const & pos)
 {
-    SEQAN_OMP_PRAGMA(parallel sections)
-    {
-        SEQAN_OMP_PRAGMA(section)
-        {    
-            updateDiscard(me.names.i1, me.namesRemove.i1, me.idents);
-        }
-        SEQAN_OMP_PRAGMA(section)
-        {
-            updateDiscard(me.seqs.i1, me.seqsRemove.i1, me.idents);
-        }
-    }
-
-    if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
-    {   
-        SEQAN_OMP_PRAGMA(parallel sections)
-        {
-            SEQAN_OMP_PRAGMA(section)
-            {    
-                updateDiscard(me.names.i2, me.namesRemove.i2, me.idents);
-            }
-            SEQAN_OMP_PRAGMA(section)
-            {
-                updateDiscard(me.seqs.i2, me.seqsRemove.i2, me.idents);
-            }
-        }
-    }
+    return discards[pos] != 0;
 }
 
 // ----------------------------------------------------------------------------
-// Function trim() - QualTail
+// Function compact()
 // ----------------------------------------------------------------------------
 
-template <typename TSeqs, typename TIdents, typename TMap, typename TThreading>
-inline void 
-trim(TSeqs & seqs, TIdents & idents, TMap & map, TThreading const & threading,
-QualTail)
+// Compact one arena in place: the range of each kept string, given by rangeOf,
+// moves to the front in order, and discarded strings are copied at the end of
+// removed when isRemove is set.  The arena is cut in one chunk per thread.
+// Strings of each chunk are counted, exclusive scans of the counts give where
+// each chunk writes, then each chunk packs its kept strings at its own start,
+// which never overwrites a string of another chunk.  Packed chunks are joined
+// last, one after another.
+template <typename TString, typename TSpec, typename TDiscards,
+typename TRange, typename TThreading>
+inline void
+compact(StringSet<TString, Owner<ConcatDirect<TSpec> > > & set,
+StringSet<TString, Owner<ConcatDirect<TSpec> > > & removed,
+TDiscards const & discards, TRange const & rangeOf, bool isRemove,
+TThreading const &)
 {
-    typedef typename Iterator<TSeqs const, Standard>::Type      TSeqsIt;
-    typedef typename Value<TSeqs const>::Type                   TSeqsValue;
-    typedef typename Position<TSeqs>::Type                      TReadPos;
-    typedef typename Size<TSeqsValue>::Type                     TSize;
-    typedef typename Id<TSeqs>::Type                            TId;
-    typedef typename TMap::mapped_type                          TParam;
-    
-    int baseQuality = static_cast<int>(map.at("base_quality"));
-    TParam baseNumber = map.at("base_number");
-    int lenPerc = -1;
-    if (map.count("len_perc"))
-        lenPerc = static_cast<int>(map.at("len_perc"));
-    
-    // Iterate.
-    iterate(seqs, [&](TSeqsIt const & it)
+    typedef StringSet<TString, Owner<ConcatDirect<TSpec> > >    TStringSet;
+    typedef typename StringSetLimits<TStringSet>::Type          TLimits;
+    typedef typename Value<TLimits>::Type                       TSize;
+    typedef typename Iterator<TString, Standard>::Type          TStringIt;
+
+    bool isParallel = IsSameType<TThreading, Parallel>::VALUE;
+    int chunks = isParallel ? omp_get_max_threads() : 1;
+
+    TLimits splitters;
+    TLimits keptCount, keptBytes, removedCount, removedBytes;
+    computeSplitters(splitters, length(set), chunks);
+    resize(keptCount, chunks + 1, 0, Exact());
+    resize(keptBytes, chunks + 1, 0, Exact());
+    resize(removedCount, chunks + 1, 0, Exact());
+    resize(removedBytes, chunks + 1, 0, Exact());
+
+    // Count strings and bytes of each chunk.
+    SEQAN_OMP_PRAGMA(parallel for if(isParallel))
+    for (int chunk = 0; chunk < chunks; ++chunk)
     {
-        TReadPos readPos = position(it, seqs);
-        TId id = positionToId(seqs, readPos);
-        TSeqsValue const & matches = value(it);
-        TSize size = length(matches);
-
-        // Discard record.
-        if(size < baseNumber)
-        {
-            idents.insert(id);
-            return;
-        }
-
-        // Main loop.
-        TSize lentokeep = size;
-        TSize count = 0;
-        for(int i = size-1; i > -1 ; --i)
+        for (TSize pos = splitters[chunk]; pos < splitters[chunk + 1]; ++pos)
         {
-            if (getQualityValue(matches[i]) <= baseQuality)
+            Pair<TSize> range = rangeOf(pos);
+            if (!isDiscarded(discards, pos))
             {
-                    ++count;
+                ++keptCount[chunk + 1];
+                keptBytes[chunk + 1] += range.i2 - range.i1;
             }
             else
             {
-                    count = 0;
+                ++removedCount[chunk + 1];
+                removedBytes[chunk + 1] += range.i2 - range.i1;
             }
+        }
+    }
 
-            if (count >= baseNumber)
-            {
-                lentokeep = i;
-            }
-        }                    
+    // Exclusive scans, index chunk is where the chunk starts writing.
+    for (int chunk = 0; chunk < chunks; ++chunk)
+    {
+        keptCount[chunk + 1] += keptCount[chunk];
+        keptBytes[chunk + 1] += keptBytes[chunk];
+        removedCount[chunk + 1] += removedCount[chunk];
+        removedBytes[chunk + 1] += removedBytes[chunk];
+    }
 
-        // Choose keeping or discarding record.
-        if (lentokeep != size)
+    TSize removedBegin = length(removed);
+    TSize removedBytesBegin = back(removed.limits);
+    if (isRemove)
+    {
+        resize(removed.concat, removedBytesBegin + back(removedBytes));
+        resize(removed.limits, removedBegin + back(removedCount) + 1);
+    }
+
+    TLimits limits;
+    resize(limits, back(keptCount) + 1, Exact());
+    limits[0] = 0;
+
+    // Pack each chunk at its own start, copy discarded strings out.
+    TStringIt concat = begin(set.concat, Standard());
+    SEQAN_OMP_PRAGMA(parallel for if(isParallel))
+    for (int chunk = 0; chunk < chunks; ++chunk)
+    {
+        TSize chunkBegin = set.limits[splitters[chunk]];
+        TStringIt packed = concat + chunkBegin;
+        TSize keptPos = keptCount[chunk];
+        TSize removedPos = removedBegin + removedCount[chunk];
+        TStringIt removedIt = begin(removed.concat, Standard()) +
+            removedBytesBegin + removedBytes[chunk];
+        for (TSize pos = splitters[chunk]; pos < splitters[chunk + 1]; ++pos)
         {
-            if(lentokeep < 1 or 
-                (lenPerc > 0 and lentokeep*100.0/size < lenPerc))
+            Pair<TSize> range = rangeOf(pos);
+            TStringIt first = concat + set.limits[pos] + range.i1;
+            TStringIt last = concat + set.limits[pos] + range.i2;
+            if (!isDiscarded(discards, pos))
             {
-                SEQAN_OMP_PRAGMA(critical)
-                {
-                    idents.insert(id);
-                }
+                packed = std::copy(first, last, packed);
+                limits[++keptPos] = keptBytes[chunk] +
+                    (packed - concat - chunkBegin);
             }
-            else
+            else if (isRemove)
             {
-                TSeqsValue seqs_trim = trimPrefix(matches, lentokeep);
-                SEQAN_OMP_PRAGMA(critical)
-                {
-                    assignValue(seqs, readPos, seqs_trim);
-                }
+                removedIt = std::copy(first, last, removedIt);
+                removed.limits[++removedPos] = 
+                    removedIt - begin(removed.concat, Standard());
             }
-        }        
-    },
-    Standard(), threading);
+        }
+    }
+
+    // Join packed chunks, chunks only move towards the front.
+    for (int chunk = 1; chunk < chunks; ++chunk)
+    {
+        TStringIt first = concat + set.limits[splitters[chunk]];
+        std::copy(first, first + keptBytes[chunk + 1] - keptBytes[chunk],
+            concat + keptBytes[chunk]);
+    }
+
+    resize(set.concat, back(keptBytes));
+    swap(set.limits, limits);
 }
 
 // ----------------------------------------------------------------------------
-// Function trim() - QualSld
+// Function update()
 // ----------------------------------------------------------------------------
 
-template <typename TSeqs, typename TIdents, typename TMap, typename TThreading>
-inline void 
-trim(TSeqs & seqs, TIdents & idents, TMap & map, TThreading const & threading,
-QualSld)
-{    
-    typedef typename Iterator<TSeqs const, Standard>::Type      TSeqsIt;
-    typedef typename Size<TSeqs>::Type                          TReadPos;
-    typedef typename Value<TSeqs const>::Type                   TSeqsValue;
-    typedef typename Size<TSeqsValue>::Type                     TSize;
-    typedef typename Id<TSeqs>::Type                            TId;
-
-    typedef typename TMap::mapped_type                          TParam;
-    typedef float                                               TFValue;
-    
-    TParam windowsLength = map.at("windows_length");
-    int meanQuality = static_cast<int>(map.at("mean_quality"));
+// Compact the batch: kept reads move to the front, in order, cut to their
+// window, and discarded reads move to the remove stores when isRemove is set.
+template <typename TSpec, typename TConfig>
+inline void _update(SeqStore<TSpec, TConfig> & me, bool isRemove)
+{
+    typedef SeqStore<TSpec, TConfig>                    TSeqStore;
+    typedef typename TSeqStore::TWindow                 TWindow;
+    typedef typename TConfig::TThreading                TThreading;
 
-    iterate(seqs, [&](TSeqsIt const & it)
+    auto names1 = [&](unsigned pos)
     {
-        TReadPos readPos = position(it, seqs);
-        TId id = positionToId(seqs, readPos);
-        TSeqsValue const & matches = value(it);
-        TSize size = length(matches);
-
-        // Discard record.
-        if(size <  windowsLength)
-        {
-            idents.insert(id);
-            return;
-        }
+        return TWindow(0, length(me.names.i1[pos]));
+    };
+    auto names2 = [&](unsigned pos)
+    {
+        return TWindow(0, length(me.names.i2[pos]));
+    };
+    auto seqs1 = [&](unsigned pos) { return me.windows.i1[pos]; };
+    auto seqs2 = [&](unsigned pos) { return me.windows.i2[pos]; };
+
+    compact(me.names.i1, me.namesRemove.i1, me.discards, names1, isRemove,
+        TThreading());
+    compact(me.seqs.i1, me.seqsRemove.i1, me.discards, seqs1, isRemove,
+        TThreading());
+    if(IsSameType<typename TConfig::TSequencing, SequencingPaired>::VALUE)
+    {
+        compact(me.names.i2, me.namesRemove.i2, me.discards, names2, isRemove,
+            TThreading());
+        compact(me.seqs.i2, me.seqsRemove.i2, me.discards, seqs2, isRemove,
+            TThreading());
+    }
+}
 
-        // Init var.
-        TFValue currSum = 0.0f;
-        TSize lentokeep = size;
+template <typename TSpec, typename TConfig>
+inline void update(SeqStore<TSpec, TConfig> & me)
+{
+    _update(me, false);
+}
 
-        // Main loop.
-        for(int i = size-1; i > -1 ; --i)
-        {
-            if((size - i) >= windowsLength)
-            {
-                if (i+windowsLength >= size)
-                {
-                    currSum += getQualityValue(matches[i]);
-                }
-                else
-                {
-                    currSum += getQualityValue(matches[i]) -
-                    getQualityValue(matches[i + windowsLength]);
-                }
-
-                if((currSum / windowsLength) < meanQuality)
-                {
-                    lentokeep = i;
-                }
-            }
-            else
-            {
-                currSum += getQualityValue(matches[i]);
-            }
-        }
+template <typename TSpec, typename TConfig>
+inline void update(SeqStore<TSpec, TConfig> & me, SeqStoreRemove)
+{
+    _update(me, true);
+}
+// ----------------------------------------------------------------------------
+// Function readBytes()
+// ----------------------------------------------------------------------------
 
-        // Crop record while last base is minus than mean quality required.
-        if(lentokeep != size)
-        {
-            bool isCrop = false;
-            while(getQualityValue(matches[lentokeep]) < meanQuality 
-                && lentokeep > 1)
-            {
-                --lentokeep;
-                isCrop = true;
-            }
-            if (isCrop)
-                ++lentokeep; // convert inclusive to exclusive
-        }
-        
-        // Choose keeping or discarding record.
-        if(lentokeep < 1 or lentokeep < windowsLength)
-        {
-            SEQAN_OMP_PRAGMA(critical)
-            {
-                idents.insert(id);
-            }
-        }
-        else if(lentokeep<size)
-        {
-            TSeqsValue seqs_trim = trimPrefix(matches, lentokeep);
-            SEQAN_OMP_PRAGMA(critical)
-            {
-                assignValue(seqs, readPos, seqs_trim);
-            }
-        }
-    },
-    Standard(), threading);    
+// The bytes of a read of Dna5Q, base | quality << 2 or 252 for N, as scanned
+// by the kernels.
+template <typename TRead>
+inline unsigned char const * readBytes(TRead const & read)
+{
+    return reinterpret_cast<unsigned char const *>(begin(read, Standard()));
 }
 
 // ----------------------------------------------------------------------------
-// Function trim() - LenMin
+// Function trimRead() - QualTail
 // ----------------------------------------------------------------------------
 
-template <typename TSeqs, typename TIdents, typename TMap, typename TThreading>
-inline void
-trim(TSeqs & seqs, TIdents & idents, TMap & map, TThreading const & threading,
-LenMin)
+// Each trimRead() looks at one read through its window, may narrow the
+// window and returns false when the read has to be discarded.
+template <typename TRead, typename TWindow>
+inline bool
+trimRead(TRead const & matches, TWindow & window,
+TrimmerParams<QualTail> const & params, QualTail)
 {
-    typedef typename Iterator<TSeqs const, Standard>::Type      TSeqsIt;
-    typedef typename Value<TSeqs const>::Type                   TSeqsValue;
-    typedef typename Size<TSeqsValue>::Type                     TSize;
-    typedef typename Id<TSeqs>::Type                            TId;
-    typedef typename TMap::mapped_type                          TParam;
+    typedef typename Size<TRead>::Type                          TSize;
 
-    TParam lenMin = map.at("len_min");
+    TSize size = length(matches);
 
-    iterate(seqs, [&](TSeqsIt const & it)
+    // Discard record.
+    if(size < params.baseNumber)
     {
-        TSeqsValue const & matches = value(it);
-        TSize size = length(matches);
-        if (size <= lenMin)
+        return false;
+    }
+
+    // First run of baseNumber low bases.
+    TSize lentokeep = findQualityRun(readBytes(matches), size,
+        params.baseQuality, params.baseNumber);
+
+    // Choose keeping or discarding record.
+    if (lentokeep != size)
+    {
+        if(lentokeep < 1 or 
+            (params.lenPerc > 0 and lentokeep*100.0/size < params.lenPerc))
         {
-            TId id = positionToId(seqs, position(it, seqs));
-            SEQAN_OMP_PRAGMA(critical)
-            {
-                idents.insert(id);
-            }
+            return false;
         }
-    },
-    Standard(), threading);
+        trimWindow(window, lentokeep);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function trimRead() - QualSld
+// ----------------------------------------------------------------------------
+
+template <typename TRead, typename TWindow>
+inline bool
+trimRead(TRead const & matches, TWindow & window,
+TrimmerParams<QualSld> const & params, QualSld)
+{    
+    typedef typename Size<TRead>::Type                          TSize;
+
+    unsigned windowsLength = params.windowsLength;
+    int meanQuality = params.meanQuality;
+    TSize size = length(matches);
+
+    // Discard record.
+    if(size <  windowsLength)
+    {
+        return false;
+    }
+
+    // First window below the mean quality, cropped back to the last base of
+    // the mean quality before it.
+    TSize lentokeep = simdKernels().windowCut(readBytes(matches), size,
+        windowsLength, meanQuality);
+
+    // Choose keeping or discarding record.
+    if(lentokeep < 1 or lentokeep < windowsLength)
+    {
+        return false;
+    }
+    else if(lentokeep<size)
+    {
+        trimWindow(window, lentokeep);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function trimRead() - LenMin
+// ----------------------------------------------------------------------------
+
+template <typename TRead, typename TWindow>
+inline bool
+trimRead(TRead const &, TWindow & window,
+TrimmerParams<LenMin> const & params, LenMin)
+{
+    return window.i2 - window.i1 > params.lenMin;
 }
 
 // ----------------------------------------------------------------------------
@@ -473,229 +522,241 @@ inline void infoInit(TSize & size, TValue & rest, TValue & steps)
 }
 
 // ----------------------------------------------------------------------------
-// Function trim() - InfoDust
+// Function dustAverage() - InfoDust
 // ----------------------------------------------------------------------------
 
-template <typename TSeqs, typename TIdents, typename TMap, typename TThreading>
-inline void 
-trim(TSeqs & seqs, TIdents & idents, TMap & map, TThreading const & threading,
-InfoDust)
+// Mean DUST score of the windows laid out by infoInit() over the size values
+// of Dna5Q.  Triplets are encoded on 2 bits as their last base comes in,
+// those holding an N are not counted.  The score of a window, its number of
+// pairs of equal triplets, is updated as triplets enter and leave it, so that
+// each base is read once.
+inline double dustAverage(unsigned char const * values, unsigned size)
 {
-
-    typedef typename Iterator<TSeqs const, Standard>::Type    TSeqsIt;
-    typedef typename Value<TSeqs const>::Type    TSeqsValue;
-    typedef typename Size<TSeqsValue>::Type        TSize;
-    typedef typename Id<TSeqs>::Type        TId;
-
-    typedef typename TMap::mapped_type TParam;
-    typedef float TFValue;
-
-    TParam cutoff = map.at("score");
-
-    iterate(seqs, [&](TSeqsIt const & it)
+    unsigned const windowStep = InfoValues<>::getWindowStep();
+    unsigned const windowTriplets = InfoValues<>::getWindowSize() - 2;
+    float const windowMax = InfoValues<>::getWindowMax();
+    float const byNum = InfoValues<>::getByNum();
+
+    unsigned rest = 0, steps = 0;
+    infoInit(size, rest, steps);
+
+    // Counts of the triplets of the window, codes of the last 64 triplets by
+    // start, 64 for a triplet holding an N.
+    unsigned counts[64] = {};
+    unsigned char codes[64];
+    unsigned code = 0, run = 0, bases = 0;
+    unsigned first = 0, last = 0, score = 0;
+    double sum = 0.0;
+
+    for (unsigned i = 0; i <= steps; ++i)
     {
-        TId id = positionToId(seqs, position(it, seqs));
-
-        TSeqsValue const & matches = value(it);
-        TSize size = length(matches);
-
-        // Init vars.
-        TParam rest = 0, steps = 0;
-        TParam start = 0;
-        TFValue score = 0.0 ;
-
-        String<unsigned> kmerCounts;
-        Accumulator<TFValue, AccuAverage> vals;
-
-        infoInit(size, rest, steps);
-
-        // Count Kmers.
-        for(unsigned i = 0; i < steps; ++i)
+        if (i == steps && rest <= 5)
         {
-            start = i * InfoValues<>::getWindowStep();
-            countKmers(kmerCounts, 
-                        infix(matches, start, start+InfoValues<>::getWindowSize()),
-                        3);
-            score = 0.0;
-            for(unsigned i = 0; i < length(kmerCounts); ++i)
-            {
-                if (kmerCounts[i] == 0)
-                    continue;
-                score += kmerCounts[i] * (kmerCounts[i] - 1) * 0.5;
-            }
-            push(vals, score * InfoValues<>::getByNum());
+            sum += 31;
+            break;
         }
+        unsigned start = i * windowStep;
+        unsigned end = i < steps ? start + windowTriplets : size - 2;
 
-        if(rest > 5)
+        // Triplets leaving the window.
+        for (; first < start; ++first)
         {
-            start = steps * InfoValues<>::getWindowStep();
-            countKmers(kmerCounts, infix(matches, start, start+rest), 3);
-            score = 0.0;
-            for(unsigned i = 0; i < length(kmerCounts); ++i)
-            {
-                if (kmerCounts[i] == 0)
-                    continue;
-                score += kmerCounts[i] * (kmerCounts[i] - 1) * 0.5;
-            }
-            push(vals, 
-                ((score / (rest - 3)) *  (InfoValues<>::getWindowMax()/(rest-2))) );
-        }
-        else
-        {
-            push(vals, 31);
+            unsigned char triplet = codes[first & 63];
+            if (triplet < 64)
+                score -= --counts[triplet];
         }
 
-        // Get mean.
-        if(trunc(average(vals) * 100 / 31 ) > cutoff)
+        // Triplets entering it.
+        for (; last < end; ++last)
         {
-            SEQAN_OMP_PRAGMA(critical)
+            for (; bases < last + 3; ++bases)
             {
-                idents.insert(id);
+                unsigned char value = values[bases];
+                code = ((code << 2) | (value & 3)) & 63;
+                run = value == 252 ? 0 : run + 1;
             }
+            unsigned char triplet = run >= 3 ? code : 64;
+            codes[last & 63] = triplet;
+            if (triplet < 64)
+                score += counts[triplet]++;
         }
 
-    },
-    Standard(), threading);
+        if (i < steps)
+            sum += float(score) * byNum;
+        else
+            sum += (float(score) / (rest - 3)) * (windowMax / (rest - 2));
+    }
+    return sum / (steps + 1);
 }
 
 // ----------------------------------------------------------------------------
-// Function trim() - InfoN
+// Function trimRead() - InfoDust
 // ----------------------------------------------------------------------------
 
-template <typename TSeqs, typename TIdents, typename TMap, typename TThreading>
-inline void
-trim(TSeqs & seqs, TIdents & idents, TMap & map, TThreading const & threading,
-InfoN)
+template <typename TRead, typename TWindow>
+inline bool
+trimRead(TRead const & matches, TWindow &,
+TrimmerParams<InfoDust> const & params, InfoDust)
 {
-    typedef typename Iterator<TSeqs, Standard>::Type        TSeqsIt;
-    typedef typename Id<TSeqs>::Type                        TId;
-    typedef typename Value<TSeqs const>::Type               TSeqsValue;
-    typedef typename Iterator<TSeqsValue, Standard>::Type   TSeqsValueIt;
-    typedef typename TMap::mapped_type                      TParam;
-
-    TParam score = map.at("score");
-
-    iterate(seqs, [&](TSeqsIt const & it)
-    {
-        TId id = positionToId(seqs, position(it, seqs));
-        TSeqsValue const & matches = value(it);
+    double average = dustAverage(readBytes(matches), length(matches));
+    return trunc(average * 100 / 31) <= params.cutoff;
+}
 
-        // Init vars.
-        TParam count = 0;
+// ----------------------------------------------------------------------------
+// Function trimRead() - InfoN
+// ----------------------------------------------------------------------------
 
-        // Main loop.
-        for (TSeqsValueIt it = begin(matches); 
-            it != end(matches, Standard()); 
-            ++it)
-        {
-            if (ordValue(value(it)) == 4)
-            {
-                ++count;
-                if (count >= score)
-                {
-                    break;
-                }
-            }
+template <typename TRead, typename TWindow>
+inline bool
+trimRead(TRead const & matches, TWindow &,
+TrimmerParams<InfoN> const & params, InfoN)
+{
+    return simdKernels().countN(readBytes(matches), length(matches)) <
+        params.score;
+}
 
-        }
+// ----------------------------------------------------------------------------
+// Function trimRead() - TrimmerPipeline
+// ----------------------------------------------------------------------------
 
-        // Discard.
-        if (count >= score)
-        {
-            SEQAN_OMP_PRAGMA(critical)
-            {
-                idents.insert(id);
-            }
-        }
+// Run the trimmers of the pipeline in order on one read, stop at the first
+// one which discards it.
+template <typename TSeq, typename TWindow, typename TChain>
+inline bool
+trimRead(TSeq const &, TWindow &, TChain const &, TrimmerPipeline<void>)
+{
+    return true;
+}
 
-    },
-    Standard(), threading);
+template <typename TSeq, typename TWindow, typename TChain, typename TTrimmer,
+typename TSubList>
+inline bool
+trimRead(TSeq const & seq, TWindow & window, TChain const & chain,
+TrimmerPipeline<TagList<TTrimmer, TSubList> >)
+{
+    if (!trimRead(infix(seq, window.i1, window.i2), window,
+        getParams(chain, TTrimmer()), TTrimmer()))
+        return false;
+    return trimRead(seq, window, chain, TrimmerPipeline<TSubList>());
 }
 
 // ----------------------------------------------------------------------------
 // Function trim()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig, typename TParam, typename TFormat_>
-inline void trim(SeqStore<TSpec, TConfig> & me, TParam & params, Tag<TFormat_>, SequencingSingle)
+template <typename TSeqs, typename TWindows, typename TDiscards,
+typename TChain, typename TThreading>
+inline void
+trim(TSeqs const &, TWindows &, TDiscards &, TChain const &,
+TrimmerPipeline<void>, TThreading const &)
+{}
+
+// One pass over the batch, each read goes through the whole pipeline.
+template <typename TSeqs, typename TWindows, typename TDiscards,
+typename TChain, typename TTrimmers, typename TThreading>
+inline void
+trim(TSeqs const & seqs, TWindows & windows, TDiscards & discards,
+TChain const & chain, TrimmerPipeline<TTrimmers> const & pipeline,
+TThreading const & threading)
 {
-    typedef Tag<TFormat_> TFormat;
-    trim(me.seqs.i1, me.idents, params, 
-        typename TConfig::TThreading(), 
-        TFormat());
+    typedef typename Iterator<TSeqs const, Standard>::Type      TSeqsIt;
+    typedef typename Position<TSeqs>::Type                      TReadPos;
+
+    iterate(seqs, [&](TSeqsIt const & it)
+    {
+        TReadPos readPos = position(it, seqs);
+        if (!trimRead(value(it), windows[readPos], chain, pipeline))
+            discardRead(discards, readPos);
+    },
+    Standard(), threading);
 }
 
-template <typename TSpec, typename TConfig, typename TParam, typename TFormat_>
-inline void trim(SeqStore<TSpec, TConfig> & me, TParam & params, Tag<TFormat_>, SequencingPaired)
+template <typename TSpec, typename TConfig, typename TChain,
+typename TPipeline>
+inline void trim(SeqStore<TSpec, TConfig> & me, TChain const & chain,
+TPipeline const & pipeline, SequencingSingle)
 {
-    typedef Tag<TFormat_> TFormat;
-    SEQAN_OMP_PRAGMA(parallel sections)
-    {
-        SEQAN_OMP_PRAGMA(section)
-        {
-            trim(me.seqs.i1, me.idents, params, 
-            Serial(), 
-            TFormat());
-        }
-        SEQAN_OMP_PRAGMA(section)
-        {
-            trim(me.seqs.i2, me.idents, params, 
-            Serial(), 
-            TFormat());
-        }
-    }
+    trim(me.seqs.i1, me.windows.i1, me.discards, chain, pipeline,
+        typename TConfig::TThreading());
 }
 
-// --------------------------------------------------------------------------
-// Function chooseTrimmer()
-// --------------------------------------------------------------------------
+// Paired: threads share the batch by ranges of pairs, both mates of a pair
+// are trimmed by the same thread which discards the pair on its own.
+template <typename TSeqs, typename TWindows, typename TDiscards,
+typename TChain, typename TThreading>
+inline void
+trim(TSeqs const &, TSeqs const &, Pair<TWindows> &, TDiscards &,
+TChain const &, TrimmerPipeline<void>, TThreading const &)
+{}
 
-template <typename TSpec, typename TConfig, typename TStringSet, 
-    typename TFormat_>
+template <typename TSeqs, typename TWindows, typename TDiscards,
+typename TChain, typename TTrimmers, typename TThreading>
 inline void
-chooseTrimmer(SeqStore<TSpec, TConfig> & me, TStringSet const & stringSet,
-Tag<TFormat_>)
+trim(TSeqs const & seqs1, TSeqs const & seqs2, Pair<TWindows> & windows,
+TDiscards & discards, TChain const & chain,
+TrimmerPipeline<TTrimmers> const & pipeline, TThreading const & threading)
 {
-    typedef Tag<TFormat_> TFormat;
+    typedef typename Iterator<TSeqs const, Standard>::Type      TSeqsIt;
+    typedef typename Position<TSeqs>::Type                      TReadPos;
 
-    for(auto & idtrimmer : stringSet)
+    SEQAN_ASSERT_EQ(length(seqs1), length(seqs2));
+    iterate(seqs1, [&](TSeqsIt const & it)
     {
-        if (std::strcmp(toCString(idtrimmer.name), 
-            IdTrimmer<TFormat_>::VALUE[0]) == 0)
-        {
-            trim(me, idtrimmer.map, TFormat(), typename TConfig::TSequencing());
-            return;
-        }
-    }
+        TReadPos readPos = position(it, seqs1);
+        // Both mates are trimmed, discarded pairs being written trimmed.
+        bool keep1 = trimRead(value(it), windows.i1[readPos], chain, pipeline);
+        bool keep2 = trimRead(seqs2[readPos], windows.i2[readPos], chain,
+            pipeline);
+        if (!keep1 || !keep2)
+            discardRead(discards, readPos);
+    },
+    Standard(), threading);
 }
 
-template <typename TSpec, typename TConfig, typename TStringSet, typename TTag>
-inline void
-chooseTrimmer(SeqStore<TSpec, TConfig> & me, TStringSet const &
-stringSet, TagList<TTag, void> const)
+template <typename TSpec, typename TConfig, typename TChain,
+typename TPipeline>
+inline void trim(SeqStore<TSpec, TConfig> & me, TChain const & chain,
+TPipeline const & pipeline, SequencingPaired)
 {
-    chooseTrimmer(me, stringSet, TTag());
+    trim(me.seqs.i1, me.seqs.i2, me.windows, me.discards, chain, pipeline,
+        typename TConfig::TThreading());
 }
 
+// ----------------------------------------------------------------------------
+// Function selectTrimmers()
+// ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig, typename TStringSet, typename TTag,
-typename TSubList>
+// Turn the enabled flags of the chain into a TrimmerPipeline type, then trim
+// with the loop instantiated for it.
+template <typename TSpec, typename TConfig, typename TChain,
+typename TTrimmers>
 inline void
-chooseTrimmer(SeqStore<TSpec, TConfig> & me, TStringSet &stringSet,
-TagList<TTag, TSubList> const)
+selectTrimmers(SeqStore<TSpec, TConfig> & me, TChain const & chain,
+TrimmerChain<void> const &, TrimmerPipeline<TTrimmers> const & pipeline)
 {
-    chooseTrimmer(me, stringSet, TTag());
-    chooseTrimmer(me, stringSet, TSubList());
+    trim(me, chain, pipeline, typename TConfig::TSequencing());
 }
 
-template <typename TSpec, typename TConfig, typename TStringSet,
-typename TTagList> 
-inline void chooseTrimmer(SeqStore<TSpec, TConfig> & me, 
-TStringSet & stringSet, TagSelector<TTagList> const)
+template <typename TSpec, typename TConfig, typename TChain, typename TTrimmer,
+typename TSubList, typename TTrimmers>
+inline void
+selectTrimmers(SeqStore<TSpec, TConfig> & me, TChain const & chain,
+TrimmerChain<TagList<TTrimmer, TSubList> > const & link,
+TrimmerPipeline<TTrimmers> const &)
 {
-    chooseTrimmer(me, stringSet, TTagList());
+    typedef typename AppendTrimmer<TTrimmers, TTrimmer>::Type   TEnabled;
+
+    if (link.enabled)
+        selectTrimmers(me, chain, link.next, TrimmerPipeline<TEnabled>());
+    else
+        selectTrimmers(me, chain, link.next, TrimmerPipeline<TTrimmers>());
 }
 
+template <typename TSpec, typename TConfig, typename TChain>
+inline void trim(SeqStore<TSpec, TConfig> & me, TChain const & chain)
+{
+    selectTrimmers(me, chain, chain, TrimmerPipeline<>());
+}
 // ----------------------------------------------------------------------------
 // Function clear()
 // ----------------------------------------------------------------------------
@@ -735,9 +796,11 @@ inline void clear(SeqStore<TSpec, TConfig> & me, SeqStoreRemove)
 }
 
 template <typename TSpec, typename TConfig>
-inline void clear(SeqStore<TSpec, TConfig> & me, SeqStoreIdent)
+inline void clear(SeqStore<TSpec, TConfig> & me, SeqStoreDiscard)
 {
-    me.idents.clear();
+    clear(me.discards);
+    clear(me.windows.i1);
+    clear(me.windows.i2);
 }
 
 template <typename TSpec, typename TConfig>
@@ -745,7 +808,7 @@ inline void clear(SeqStore<TSpec, TConfig> & me)
 {
     clear(me, SeqStoreValue());
     clear(me, SeqStoreRemove());
-    clear(me, SeqStoreIdent());
+    clear(me, SeqStoreDiscard());
 }
 
 // ----------------------------------------------------------------------------
@@ -769,6 +832,59 @@ inline void size(SeqStore<TSpec, TConfig> const & me, TValue & len)
     len += length(me.names.i1);
 }
 
+// ----------------------------------------------------------------------------
+// Function memoryFootprint()
+// ----------------------------------------------------------------------------
+
+// Bytes held by a string set: its arena and its limits.
+template <typename TString, typename TSpec>
+inline unsigned long
+memoryFootprint(StringSet<TString, Owner<ConcatDirect<TSpec> > > const & set)
+{
+    return capacity(set.concat) * sizeof(typename Value<TString>::Type) +
+        capacity(set.limits) * sizeof(typename Value<decltype(set.limits)>::Type);
+}
+
+template <typename TValue>
+inline unsigned long memoryFootprint(Triple<TValue> const & triple)
+{
+    return memoryFootprint(triple.i1) + memoryFootprint(triple.i2) +
+        memoryFootprint(triple.i3);
+}
+
+// Bytes held by a batch: reads, discarded reads, flags and windows.
+template <typename TSpec, typename TConfig>
+inline unsigned long memoryFootprint(SeqStore<TSpec, TConfig> const & me)
+{
+    typedef SeqStore<TSpec, TConfig>                    TSeqStore;
+
+    return memoryFootprint(me.names) + memoryFootprint(me.seqs) +
+        memoryFootprint(me.namesRemove) + memoryFootprint(me.seqsRemove) +
+        capacity(me.discards) +
+        (capacity(me.windows.i1) + capacity(me.windows.i2)) *
+        sizeof(typename TSeqStore::TWindow);
+}
+
+// ----------------------------------------------------------------------------
+// Function memoryUsed()
+// ----------------------------------------------------------------------------
+
+// Bytes filled in a string set, arenas keep more from previous batches.
+template <typename TString, typename TSpec>
+inline unsigned long
+memoryUsed(StringSet<TString, Owner<ConcatDirect<TSpec> > > const & set)
+{
+    return length(set.concat) * sizeof(typename Value<TString>::Type) +
+        length(set.limits) * sizeof(typename Value<decltype(set.limits)>::Type);
+}
+
+template <typename TValue>
+inline unsigned long memoryUsed(Triple<TValue> const & triple)
+{
+    return memoryUsed(triple.i1) + memoryUsed(triple.i2) +
+        memoryUsed(triple.i3);
+}
+
 // ----------------------------------------------------------------------------
 // Function statsDistributionReads()
 // ----------------------------------------------------------------------------
@@ -789,25 +905,38 @@ statsDistributionReads(TSeqs & seqs, TMap & map)
     Standard(), Serial());    
 }
 
+// ----------------------------------------------------------------------------
+// Function skipRecords()
+// ----------------------------------------------------------------------------
+
+// Read count records at most without keeping them, returns their number.
+template <typename TSize>
+inline TSize skipRecords(SeqFileIn & me, TSize count)
+{
+    CharString name, seq, qual;
+    TSize skipped = 0;
+    for (; skipped < count && !atEnd(me); ++skipped)
+        readRecord(name, seq, qual, me);
+    return skipped;
+}
+
 // ----------------------------------------------------------------------------
 // Function readRecords()
 // ----------------------------------------------------------------------------
 
-template <typename TSpec, typename TConfig, typename TFileSpec,
-typename TValue>
+// Input files are SeqFileIn streams, FastqMap mapped files, GzipFileIn mapped
+// gzip files or ZstdFileIn mapped zstd files.
+template <typename TSpec, typename TConfig, typename TFileIn, typename TValue>
 inline void
-readRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Input, TFileSpec>> & fileIn,
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
 TValue const & readBatch, FFastq, SequencingSingle)
 {
     readRecords(me.names.i1, me.seqs.i1, fileIn.i1, readBatch);
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec,
-typename TValue>
+template <typename TSpec, typename TConfig, typename TFileIn, typename TValue>
 inline void 
-readRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Input, TFileSpec>> & fileIn, 
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<TFileIn> & fileIn, 
 TValue const & readBatch, FFastq, SequencingPaired)
 {
     SEQAN_OMP_PRAGMA(parallel sections)
@@ -823,195 +952,206 @@ TValue const & readBatch, FFastq, SequencingPaired)
     }
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec,
-typename TValue>
+// Mapped files are parsed by all the threads, one file after the other.
+template <typename TSpec, typename TConfig, typename TValue>
+inline void 
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<FastqMap> & fileIn, 
+TValue const & readBatch, FFastq, SequencingPaired)
+{
+    readRecords(me.names.i1, me.seqs.i1, fileIn.i1, readBatch);
+    readRecords(me.names.i2, me.seqs.i2, fileIn.i2, readBatch);
+}
+
+template <typename TSpec, typename TConfig, typename TValue>
+inline void 
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<GzipFileIn> & fileIn, 
+TValue const & readBatch, FFastq, SequencingPaired)
+{
+    readRecords(me.names.i1, me.seqs.i1, fileIn.i1, readBatch);
+    readRecords(me.names.i2, me.seqs.i2, fileIn.i2, readBatch);
+}
+
+template <typename TSpec, typename TConfig, typename TValue>
+inline void 
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<ZstdFileIn> & fileIn, 
+TValue const & readBatch, FFastq, SequencingPaired)
+{
+    readRecords(me.names.i1, me.seqs.i1, fileIn.i1, readBatch);
+    readRecords(me.names.i2, me.seqs.i2, fileIn.i2, readBatch);
+}
+
+template <typename TSpec, typename TConfig, typename TFileIn, typename TValue>
 inline void
-readRecords(SeqStore<TSpec, TConfig>,
-Pair<FormattedFile<Fastq, Input, TFileSpec>>, TValue, FInterleaved,
-SequencingSingle)
+readRecords(SeqStore<TSpec, TConfig> &, Pair<TFileIn> &, TValue const &,
+FInterleaved, SequencingSingle)
 {
     return;
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec,
-typename TValue>
+template <typename TSpec, typename TConfig, typename TFileIn, typename TValue>
 inline void
-readRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Input, TFileSpec>> & fileIn,
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
 TValue const & readBatch, FInterleaved, SequencingPaired)
 {
-    typedef typename TConfig::TAlphabet                 TAlphabet;
-    typedef typename TConfig::TAlphabetSequence         TAlphabetSequence;
-    typedef typename TConfig::TSeqSpec                  TSeqSpec;
+    // Mates are split by splitRecords() once the batch is read.
+    readRecords(me.names.i3, me.seqs.i3, fileIn.i1, readBatch);
+}
+
+// ----------------------------------------------------------------------------
+// Function splitRecords()
+// ----------------------------------------------------------------------------
 
+template <typename TSpec, typename TConfig, typename TFormat,
+typename TSequencing>
+inline void
+splitRecords(SeqStore<TSpec, TConfig> &, TFormat, TSequencing)
+{}
+
+template <typename TSpec, typename TConfig>
+inline void
+splitRecords(SeqStore<TSpec, TConfig> & me, FInterleaved, SequencingPaired)
+{
+    typedef typename TConfig::TAlphabet                 TAlphabet;
     typedef typename TConfig::TSeqsNameSpec             TSeqsNameSpec;
-    typedef typename TConfig::TSeqsSpec                 TSeqsSpec;
 
     typedef StringSet<TAlphabet, TSeqsNameSpec>         TSeqName;
-    typedef typename Iterator<TSeqName, Standard>::Type TSeqNameIt;
-    typedef typename Value<TSeqName>::Type              TSeqNameValue;
     typedef typename Size<TSeqName>::Type               TSize;
 
-    typedef String<TAlphabetSequence, TSeqSpec>         TSeq;
-    typedef StringSet<TSeq, TSeqsSpec>                  TSeqs;
-    typedef typename Iterator<TSeqs, Standard>::Type    TSeqsIt;
-
-    // Read all.
-    readRecords(me.names.i3, me.seqs.i3, fileIn.i1, readBatch);
-
-    TSize lenRecords = length(me.names.i3) / 2;
-    SEQAN_ASSERT_EQ(lenRecords%2, 0);
+    SEQAN_ASSERT_EQ(length(me.names.i3)%2, 0);
 
     // Remove specific interleaved extension name.
     String<CharString> needles;
     appendValue(needles, "\\1");
     appendValue(needles, "\\2");
     Pattern<String<CharString>, WuManber> pattern(needles);
-    CharString srep("");
-    iterate(me.names.i3, [&](TSeqNameIt const & it)
+
+    // Copy mates out of the interleaved store, the interleaved store is only
+    // a buffer for reading.
+    CharString name;
+    for (TSize pos = 0; pos < length(me.names.i3); ++pos)
     {
-        TSeqNameValue & name = value(it);
+        assign(name, me.names.i3[pos]);
         Finder<CharString> finder(name);
         if (find(finder, pattern))
         {
-            replace(name, beginPosition(finder), endPosition(finder), srep);
+            erase(name, beginPosition(finder), endPosition(finder));
         }
-    },
-    Standard(), Serial());
-    
-    // Reserve.
-    reserve(me.names.i1, lenRecords, Exact());
-    reserve(me.seqs.i1, lenRecords, Exact());
-
-    reserve(me.names.i2, lenRecords, Exact());
-    reserve(me.seqs.i2, lenRecords, Exact());
-        
-    // Populate.
-    TSeqNameIt itNames = begin(me.names.i3);
-    TSeqsIt itSeqs = begin(me.seqs.i3);
-    TSize size = length(me.names.i3);
-    
-    for(TSize step = 0; step < size; ++step, ++itNames, ++itSeqs)
-    {
-        
-        if (step%2==0)
+        if (pos % 2 == 0)
         {
-            appendValue(me.names.i1, value(itNames));
-            appendValue(me.seqs.i1, value(itSeqs));
+            appendValue(me.names.i1, name);
+            appendValue(me.seqs.i1, me.seqs.i3[pos]);
         }
         else
         {
-            appendValue(me.names.i2, value(itNames));
-            appendValue(me.seqs.i2, value(itSeqs));
+            appendValue(me.names.i2, name);
+            appendValue(me.seqs.i2, me.seqs.i3[pos]);
         }
     }
+    clear(me.names.i3);
+    clear(me.seqs.i3);
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec,
-typename TValue>
+// Read readBatch records at most.  With a batchMemory budget in bytes, records
+// are read by chunks until the names and sequences read hold the budget.
+template <typename TSpec, typename TConfig, typename TFileIn, typename TValue,
+typename TBytes>
 inline void
-readRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Input, TFileSpec>> & fileIn, TValue const& readBatch)
+readRecords(SeqStore<TSpec, TConfig> & me, Pair<TFileIn> & fileIn,
+TValue const & readBatch, TBytes const & batchMemory)
 {
-    readRecords(me, fileIn, readBatch, 
-    typename TConfig::TInputFormat(), 
+    typedef SeqStore<TSpec, TConfig>                    TSeqStore;
+    typedef typename Size<typename TSeqStore::TSeqs>::Type  TSize;
+
+    // Records read between two checks of the budget.
+    TValue const chunkRecords = 4096;
+
+    TValue count = 0;
+    TBytes bytes = 0;
+    while (count < readBatch && (batchMemory == 0 || bytes < batchMemory))
+    {
+        TValue chunk = readBatch - count;
+        if (batchMemory > 0 && chunk > chunkRecords)
+            chunk = chunkRecords;
+
+        TSize from1 = length(me.names.i1);
+        TSize from3 = length(me.names.i3);
+        readRecords(me, fileIn, chunk, 
+        typename TConfig::TInputFormat(), 
+        typename TConfig::TSequencing());
+        TValue records = (length(me.names.i1) - from1) +
+            (length(me.names.i3) - from3);
+
+        bytes = memoryUsed(me.names) + memoryUsed(me.seqs);
+        count += records;
+        if (records < chunk)
+            break;
+    }
+
+    splitRecords(me, typename TConfig::TInputFormat(), 
     typename TConfig::TSequencing());
+    adviseHugePages(me.names);
+    adviseHugePages(me.seqs);
+    resize(me.discards, length(me.seqs.i1), 0, Exact());
+    initWindows(me);
 }
 
 // ----------------------------------------------------------------------------
 // Function writeRecords()
 // ----------------------------------------------------------------------------
 
-template <typename TFileSpec, typename TNames, typename TSeqs>
+template <typename TFileOut, typename TNames, typename TSeqs>
 inline void
 writeRecords(TNames & names, TSeqs & seqs,
-FormattedFile<Fastq, Output, TFileSpec> & fileOut, FInterleaved)
+TFileOut & fileOut, FInterleaved)
 {
     typedef typename Value<TNames, 1>::Type                 TNamesValue;
-    typedef typename Value<TNamesValue>::Type               TTNamesValue;
     typedef typename Size<TNamesValue>::Type                TSize;
-    typedef typename Iterator<TNamesValue, Standard>::Type  TNamesIt;
-    
-    typedef typename Value<TSeqs, 1>::Type                  TSeqsValue;
-    typedef typename Iterator<TSeqsValue, Standard>::Type   TSeqsIt;
-    
-    // Init values.
-    TSize lenRecordsForward = length(names.i1);
-    TSize lenRecordsReverse = length(names.i2);
-    SEQAN_ASSERT_EQ(lenRecordsForward, lenRecordsReverse);
-    TSize lenRecordsTotal = lenRecordsForward + lenRecordsReverse;
 
-    // Specific interleaved.
-    SEQAN_OMP_PRAGMA(parallel sections)
+    SEQAN_ASSERT_EQ(length(names.i1), length(names.i2));
+
+    // Mates one after the other, with the interleaved extension name.
+    CharString name;
+    for (TSize pos = 0; pos < length(names.i1); ++pos)
     {
-        SEQAN_OMP_PRAGMA(section)
-        {  
-            reserve(names.i3, lenRecordsTotal, Exact());
-            TNamesIt itNamesForward = begin(names.i1, Standard());
-            TNamesIt itNamesReverse = begin(names.i2, Standard());
-        
-            for (;
-                itNamesForward != end(names.i1) || itNamesReverse != end(names.i2); 
-                ++itNamesForward, ++itNamesReverse)
-            {
-                TTNamesValue & nameForward = value(itNamesForward);
-                append(nameForward, "\\1");
-                appendValue(names.i3, nameForward);
+        assign(name, names.i1[pos]);
+        append(name, "\\1");
+        writeRecord(fileOut, name, seqs.i1[pos]);
 
-                TTNamesValue & nameReverse = value(itNamesReverse);
-                append(nameReverse, "\\2");
-                appendValue(names.i3, nameReverse);
-            }
-        }
-        SEQAN_OMP_PRAGMA(section)
-        {
- 
-            reserve(seqs.i3, lenRecordsTotal, Exact());
-            TSeqsIt itSeqsForward = begin(seqs.i1, Standard());
-            TSeqsIt itSeqsReverse = begin(seqs.i2, Standard());
-            for (;
-                itSeqsForward != end(seqs.i1) || itSeqsReverse != end(seqs.i2); 
-                ++itSeqsForward, ++itSeqsReverse)
-            {
-                appendValue(seqs.i3, value(itSeqsForward));
-                appendValue(seqs.i3, value(itSeqsReverse));
-            }
-        }
+        assign(name, names.i2[pos]);
+        append(name, "\\2");
+        writeRecord(fileOut, name, seqs.i2[pos]);
     }
-    // Write.
-    writeRecords(fileOut, names.i3, seqs.i3);
 }
 
-
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut, FInterleaved)
+Pair<TFileOut> & fileOut, FInterleaved)
 {
     writeRecords(me.names, me.seqs, fileOut.i1, FInterleaved());
 }
 
 
-template <typename TFileSpec, typename TNames, typename TSeqs>
+template <typename TFileOut, typename TNames, typename TSeqs>
 inline void
 writeRecords(TNames const & names, TSeqs const & seqs, 
-FormattedFile<Fastq, Output, TFileSpec> & fileOut, FFastq, SequencingSingle)
+TFileOut & fileOut, FFastq, SequencingSingle)
 {
     writeRecords(fileOut, names.i1, seqs.i1);
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut, FFastq, SequencingSingle)
+Pair<TFileOut> & fileOut, FFastq, SequencingSingle)
 {
     writeRecords(me.names, me.seqs, fileOut.i1, FFastq(), SequencingSingle());
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut, FFastq, SequencingPaired)
+Pair<TFileOut> & fileOut, FFastq, SequencingPaired)
 {
     SEQAN_OMP_PRAGMA(parallel sections)
     {
@@ -1026,43 +1166,53 @@ Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut, FFastq, SequencingPaire
     }
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+// Block files are compressed by all the threads, one file after the other.
+template <typename TSpec, typename TConfig>
+inline void
+writeRecords(SeqStore<TSpec, TConfig> & me,
+Pair<BlockFileOut> & fileOut, FFastq, SequencingPaired)
+{
+    writeRecords(fileOut.i1, me.names.i1, me.seqs.i1);
+    writeRecords(fileOut.i2, me.names.i2, me.seqs.i2);
+}
+
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut, FFastq)
+Pair<TFileOut> & fileOut, FFastq)
 {
     writeRecords(me, fileOut, FFastq(), typename TConfig::TSequencing());
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-Pair<FormattedFile<Fastq, Output, TFileSpec>> & fileOut)
+Pair<TFileOut> & fileOut)
 {
     writeRecords(me, fileOut, typename TConfig::TOutputFormat());
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me,
-FormattedFile<Fastq, Output, TFileSpec> & fileOut, SequencingPaired)
+TFileOut & fileOut, SequencingPaired)
 {
     writeRecords(me.namesRemove, me.seqsRemove, fileOut, FInterleaved());
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void 
 writeRecords(SeqStore<TSpec, TConfig> & me,
-FormattedFile<Fastq, Output, TFileSpec> & fileOut, SequencingSingle)
+TFileOut & fileOut, SequencingSingle)
 {
     writeRecords(me.namesRemove, me.seqsRemove, fileOut, FFastq(), 
     SequencingSingle());
 }
 
-template <typename TSpec, typename TConfig, typename TFileSpec>
+template <typename TSpec, typename TConfig, typename TFileOut>
 inline void
 writeRecords(SeqStore<TSpec, TConfig> & me, 
-FormattedFile<Fastq, Output, TFileSpec> & fileOut)
+TFileOut & fileOut)
 {
     writeRecords(me, fileOut, typename TConfig::TSequencing());
 }
@@ -0,0 +1,412 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Count and place threads
+// ============================================================================
+#ifndef APP_HMNTRIMMER_THREADS_H_
+#define APP_HMNTRIMMER_THREADS_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
+#include <seqan/sequence.h>
+
+using namespace seqan;
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class CpuTopology
+// ----------------------------------------------------------------------------
+
+// CPUs the process may run on, ordered by NUMA node, and the node of each one.
+struct CpuTopology
+{
+    String<int>     cpus;
+    String<int>     nodes;
+
+    CpuTopology() :
+        cpus(),
+        nodes()
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function readCpuList()
+// ----------------------------------------------------------------------------
+
+// Parse a kernel cpu list such as "0-15,32-47".
+inline void readCpuList(String<int> & cpus, std::string const & path)
+{
+    std::ifstream file(path);
+    std::string list;
+    if (!std::getline(file, list))
+        return;
+
+    std::size_t pos = 0;
+    while (pos < list.size())
+    {
+        std::size_t next = list.find(',', pos);
+        if (next == std::string::npos)
+            next = list.size();
+        std::string range = list.substr(pos, next - pos);
+        std::size_t dash = range.find('-');
+        try
+        {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first :
+                std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                appendValue(cpus, cpu);
+        }
+        catch (std::exception const &)
+        {}
+        pos = next + 1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function cgroupPath()
+// ----------------------------------------------------------------------------
+
+// Path of the cgroup of the process in the hierarchy of the controller, or in
+// the cgroup v2 one for an empty controller, from "id:controllers:path" lines.
+// The root is the empty path.
+inline std::string cgroupPath(std::string const & controller)
+{
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::size_t first = line.find(':');
+        std::size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos)
+            continue;
+        std::string controllers = "," +
+            line.substr(first + 1, second - first - 1) + ",";
+        if (controller.empty() ? controllers == ",," :
+            controllers.find("," + controller + ",") != std::string::npos)
+            return line.substr(second + 1) == "/" ? "" :
+                line.substr(second + 1);
+    }
+    return "";
+}
+
+// ----------------------------------------------------------------------------
+// Function parentCgroup()
+// ----------------------------------------------------------------------------
+
+// Cut the last component of a cgroup path, false at the root.
+inline bool parentCgroup(std::string & path)
+{
+    if (path.empty())
+        return false;
+    std::size_t slash = path.rfind('/');
+    path.resize(slash == std::string::npos ? 0 : slash);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Function cgroupCpuLimit()
+// ----------------------------------------------------------------------------
+
+// Number of CPUs allowed by the cgroup quota, rounded up, 0 if unlimited.  The
+// quotas of the cgroup of the process and of its ancestors all apply, the
+// lowest one is kept.
+inline unsigned cgroupCpuLimit()
+{
+    unsigned limit = 0;
+    auto addQuota = [&limit](double quota, double period)
+    {
+        if (quota <= 0 || period <= 0)
+            return;
+        unsigned cpus = std::max(1u,
+            static_cast<unsigned>((quota + period - 1) / period));
+        limit = limit == 0 ? cpus : std::min(limit, cpus);
+    };
+
+    // cgroup v2: "max 100000" or "<quota> <period>", the root has no file.
+    bool isV2 = false;
+    std::string path = cgroupPath("");
+    do
+    {
+        std::ifstream cpuMax("/sys/fs/cgroup" + path + "/cpu.max");
+        std::string squota;
+        double period = 0;
+        if (cpuMax >> squota >> period)
+        {
+            isV2 = true;
+            if (squota != "max")
+                addQuota(std::stod(squota), period);
+        }
+    }
+    while (parentCgroup(path));
+    if (isV2)
+        return limit;
+
+    // cgroup v1: quota is -1 when unlimited.
+    for (std::string dir : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"})
+    {
+        path = cgroupPath("cpu");
+        do
+        {
+            std::ifstream cfsQuota(dir + path + "/cpu.cfs_quota_us");
+            std::ifstream cfsPeriod(dir + path + "/cpu.cfs_period_us");
+            double quota = -1, period = 0;
+            if (cfsQuota >> quota && cfsPeriod >> period)
+                addQuota(quota, period);
+        }
+        while (parentCgroup(path));
+        if (limit > 0)
+            break;
+    }
+    return limit;
+}
+
+// ----------------------------------------------------------------------------
+// Function initCpuTopology()
+// ----------------------------------------------------------------------------
+
+inline void initCpuTopology(CpuTopology & topology)
+{
+    clear(topology.cpus);
+    clear(topology.nodes);
+
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+        return;
+
+    // Allowed CPUs of each node, nodes in increasing order.
+    String<Pair<int> > placed;
+    if (DIR * dir = opendir("/sys/devices/system/node"))
+    {
+        while (struct dirent * entry = readdir(dir))
+        {
+            std::string name(entry->d_name);
+            if (name.compare(0, 4, "node") != 0 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos ||
+                name.size() == 4)
+                continue;
+            int node = std::stoi(name.substr(4));
+            String<int> cpus;
+            readCpuList(cpus, "/sys/devices/system/node/" + name + "/cpulist");
+            for (int cpu : cpus)
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask))
+                    appendValue(placed, Pair<int>(node, cpu));
+        }
+        closedir(dir);
+    }
+
+    // No NUMA information: one node with every allowed CPU.
+    if (empty(placed))
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &mask))
+                appendValue(placed, Pair<int>(0, cpu));
+    }
+
+    std::sort(begin(placed, Standard()), end(placed, Standard()));
+    for (auto const & nodeCpu : placed)
+    {
+        appendValue(topology.nodes, nodeCpu.i1);
+        appendValue(topology.cpus, nodeCpu.i2);
+    }
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function autoThreadsCount()
+// ----------------------------------------------------------------------------
+
+// Threads worth running: the CPUs of the affinity mask, within the cgroup
+// quota.
+inline unsigned autoThreadsCount()
+{
+    CpuTopology topology;
+    initCpuTopology(topology);
+
+    unsigned count = length(topology.cpus);
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+
+    unsigned limit = cgroupCpuLimit();
+    if (limit > 0)
+        count = std::min(count, limit);
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+// Function pinThread()
+// ----------------------------------------------------------------------------
+
+// Pin the calling thread to the slot-th CPU of the topology.  Slots follow
+// node order, so consecutive workers share a node.
+inline void pinThread(CpuTopology const & topology, unsigned slot)
+{
+#ifdef __linux__
+    if (empty(topology.cpus))
+        return;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(topology.cpus[slot % length(topology.cpus)], &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#else
+    ignoreUnusedVariableWarning(topology);
+    ignoreUnusedVariableWarning(slot);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function pinThreadSlots()
+// ----------------------------------------------------------------------------
+
+// Pin the calling thread to the CPUs of the count slots from first, so that
+// the OpenMP team it starts runs on them.
+inline void pinThreadSlots(CpuTopology const & topology, unsigned first,
+unsigned count)
+{
+#ifdef __linux__
+    if (empty(topology.cpus))
+        return;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (unsigned slot = first; slot < first + std::max(1u, count); ++slot)
+        CPU_SET(topology.cpus[slot % length(topology.cpus)], &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#else
+    ignoreUnusedVariableWarning(topology);
+    ignoreUnusedVariableWarning(first);
+    ignoreUnusedVariableWarning(count);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function threadCpuCount()
+// ----------------------------------------------------------------------------
+
+// CPUs the calling thread may run on, 0 if unknown.
+inline unsigned threadCpuCount()
+{
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0)
+        return CPU_COUNT(&mask);
+#endif
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function bindMemoryNodes()
+// ----------------------------------------------------------------------------
+
+// Move [data, data + size) to the nodes of the first count slots, the t-th of
+// count equal slices to the node of slot t, as the reads of a batch are
+// shared by the trimming team.  Pages touched later go to the same nodes.
+// Only whole huge pages are moved, so that they are not split.
+inline void bindMemoryNodes(CpuTopology const & topology, unsigned count,
+void const * data, std::size_t size)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    // MPOL_PREFERRED and MPOL_MF_MOVE of <numaif.h>.
+    int const preferred = 1;
+    unsigned const move = 1u << 1;
+
+    if (empty(topology.nodes) || count < 2)
+        return;
+    std::uintptr_t const hugePage = 2ul << 20;
+    std::uintptr_t first = reinterpret_cast<std::uintptr_t>(data);
+    std::uintptr_t last = (first + size) & ~(hugePage - 1);
+    first = (first + hugePage - 1) & ~(hugePage - 1);
+    if (first >= last)
+        return;
+
+    std::uintptr_t pages = (last - first) / hugePage;
+    unsigned slot = 0;
+    while (slot < count)
+    {
+        // Consecutive slots of one node make one range.
+        int node = topology.nodes[slot % length(topology.nodes)];
+        unsigned next = slot + 1;
+        while (next < count &&
+            topology.nodes[next % length(topology.nodes)] == node)
+            ++next;
+        if (slot == 0 && next == count)
+            return;
+
+        std::uintptr_t from = first + hugePage * (pages * slot / count);
+        std::uintptr_t to = first + hugePage * (pages * next / count);
+        unsigned long mask[16] = {};
+        int const bits = 8 * sizeof(unsigned long);
+        if (from < to && node >= 0 && node < 16 * bits)
+        {
+            mask[node / bits] |= 1ul << (node % bits);
+            syscall(SYS_mbind, from, to - from, preferred, mask, 16 * bits + 1,
+                move);
+        }
+        slot = next;
+    }
+#else
+    ignoreUnusedVariableWarning(topology);
+    ignoreUnusedVariableWarning(count);
+    ignoreUnusedVariableWarning(data);
+    ignoreUnusedVariableWarning(size);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function pinOpenMPThreads()
+// ----------------------------------------------------------------------------
+
+// Pin each thread of the OpenMP team, the team is kept by the runtime for the
+// next parallel regions of the same size.
+inline void pinOpenMPThreads(CpuTopology const & topology, unsigned count)
+{
+#ifdef _OPENMP
+    SEQAN_OMP_PRAGMA(parallel num_threads(count))
+    {
+        pinThread(topology, omp_get_thread_num());
+    }
+#else
+    ignoreUnusedVariableWarning(count);
+    pinThread(topology, 0);
+#endif
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_THREADS_H_
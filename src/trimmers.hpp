@@ -163,6 +163,90 @@ char const * IdTrimmer<InfoN_, T>::VALUE[1] =
     "InfoN"
 };
 
+// ----------------------------------------------------------------------------
+// Class TrimmerParams
+// ----------------------------------------------------------------------------
+
+// Parameters of a trimmer, read once from its ArgTrimmer map.
+template <typename TTrimmer>
+struct TrimmerParams;
+
+template <>
+struct TrimmerParams<QualTail>
+{
+    int         baseQuality;
+    unsigned    baseNumber;
+    int         lenPerc;
+
+    TrimmerParams() : baseQuality(0), baseNumber(0), lenPerc(-1) {}
+};
+
+template <>
+struct TrimmerParams<QualSld>
+{
+    unsigned    windowsLength;
+    int         meanQuality;
+
+    TrimmerParams() : windowsLength(0), meanQuality(0) {}
+};
+
+template <>
+struct TrimmerParams<LenMin>
+{
+    unsigned    lenMin;
+
+    TrimmerParams() : lenMin(0) {}
+};
+
+template <>
+struct TrimmerParams<InfoDust>
+{
+    unsigned    cutoff;
+
+    TrimmerParams() : cutoff(0) {}
+};
+
+template <>
+struct TrimmerParams<InfoN>
+{
+    unsigned    score;
+
+    TrimmerParams() : score(0) {}
+};
+
+// ----------------------------------------------------------------------------
+// Class TrimmerChain
+// ----------------------------------------------------------------------------
+
+// Trimmers of a TagList, in order, each one with its parameters and a flag
+// telling if it has been asked for on the command line.
+template <typename TTrimmers>
+struct TrimmerChain;
+
+template <>
+struct TrimmerChain<void>
+{};
+
+template <typename TTrimmer, typename TSubList>
+struct TrimmerChain<TagList<TTrimmer, TSubList> >
+{
+    bool                        enabled;
+    TrimmerParams<TTrimmer>     params;
+    TrimmerChain<TSubList>      next;
+
+    TrimmerChain() : enabled(false), params(), next() {}
+};
+
+// ----------------------------------------------------------------------------
+// Class TrimmerPipeline
+// ----------------------------------------------------------------------------
+
+// Only the trimmers of a TrimmerChain which are enabled, as a TagList. The
+// per-read loop is instantiated for it and never tests a trimmer flag.
+template <typename TTrimmers = void>
+struct TrimmerPipeline
+{};
+
 // ----------------------------------------------------------------------------
 // Class InfoValues
 // ----------------------------------------------------------------------------
@@ -201,4 +285,113 @@ struct InfoValues
     }
 };
 
+// ============================================================================
+// Metafunctions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Metafunction AppendTrimmer
+// ----------------------------------------------------------------------------
+
+template <typename TTrimmers, typename TTrimmer>
+struct AppendTrimmer;
+
+template <typename TTrimmer>
+struct AppendTrimmer<void, TTrimmer>
+{
+    typedef TagList<TTrimmer>                                   Type;
+};
+
+template <typename THead, typename TSubList, typename TTrimmer>
+struct AppendTrimmer<TagList<THead, TSubList>, TTrimmer>
+{
+    typedef TagList<THead,
+        typename AppendTrimmer<TSubList, TTrimmer>::Type>       Type;
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function setParams()
+// ----------------------------------------------------------------------------
+
+template <typename TMap>
+inline void setParams(TrimmerParams<QualTail> & params, TMap const & map)
+{
+    params.baseQuality = static_cast<int>(map.at("base_quality"));
+    params.baseNumber = map.at("base_number");
+    if (map.count("len_perc"))
+        params.lenPerc = static_cast<int>(map.at("len_perc"));
+}
+
+template <typename TMap>
+inline void setParams(TrimmerParams<QualSld> & params, TMap const & map)
+{
+    params.windowsLength = map.at("windows_length");
+    params.meanQuality = static_cast<int>(map.at("mean_quality"));
+}
+
+template <typename TMap>
+inline void setParams(TrimmerParams<LenMin> & params, TMap const & map)
+{
+    params.lenMin = map.at("len_min");
+}
+
+template <typename TMap>
+inline void setParams(TrimmerParams<InfoDust> & params, TMap const & map)
+{
+    params.cutoff = map.at("score");
+}
+
+template <typename TMap>
+inline void setParams(TrimmerParams<InfoN> & params, TMap const & map)
+{
+    params.score = map.at("score");
+}
+
+// ----------------------------------------------------------------------------
+// Function setTrimmers()
+// ----------------------------------------------------------------------------
+
+template <typename TStringSet>
+inline void setTrimmers(TrimmerChain<void> &, TStringSet const &)
+{}
+
+template <typename TTrimmer_, typename TSubList, typename TStringSet>
+inline void setTrimmers(TrimmerChain<TagList<Tag<TTrimmer_>, TSubList> > &
+chain, TStringSet const & stringSet)
+{
+    for(auto & idtrimmer : stringSet)
+    {
+        if (std::strcmp(toCString(idtrimmer.name), 
+            IdTrimmer<TTrimmer_>::VALUE[0]) == 0)
+        {
+            chain.enabled = true;
+            setParams(chain.params, idtrimmer.map);
+            break;
+        }
+    }
+    setTrimmers(chain.next, stringSet);
+}
+
+// ----------------------------------------------------------------------------
+// Function getParams()
+// ----------------------------------------------------------------------------
+
+template <typename TTrimmer, typename TSubList>
+inline TrimmerParams<TTrimmer> const &
+getParams(TrimmerChain<TagList<TTrimmer, TSubList> > const & chain, TTrimmer)
+{
+    return chain.params;
+}
+
+template <typename THead, typename TSubList, typename TTrimmer>
+inline TrimmerParams<TTrimmer> const &
+getParams(TrimmerChain<TagList<THead, TSubList> > const & chain, TTrimmer)
+{
+    return getParams(chain.next, TTrimmer());
+}
+
 #endif  // #ifndef APP_HMNTRIMMER_TRIMMER_H_
@@ -0,0 +1,360 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Chunks of a run shared by processes through a directory
+// ============================================================================
+#ifndef APP_HMNTRIMMER_WORK_QUEUE_H_
+#define APP_HMNTRIMMER_WORK_QUEUE_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+using namespace seqan;
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class WorkQueue
+// ----------------------------------------------------------------------------
+
+// The chunks of a run in the directory dir, shared by every process started
+// on it.  Chunk k is claimed by creating chunk-K.lock.0 exclusively, and
+// completed by chunk-K.done.  The owner refreshes the time of its lock while
+// it works; a lock older than timeout seconds on the clock of the file system
+// is stale, its chunk is claimed again by creating the lock of the next
+// generation.  Owner names the files
+// written by this process, host.pid.
+struct WorkQueue
+{
+    CharString      dir;
+    unsigned        chunks;
+    unsigned        timeout;
+    CharString      owner;
+
+    WorkQueue() :
+        dir(),
+        chunks(1),
+        timeout(600),
+        owner()
+    {};
+};
+
+// ----------------------------------------------------------------------------
+// Class WorkHeartbeat
+// ----------------------------------------------------------------------------
+
+// Refresh the lock of a chunk every period from a thread of its own, until
+// stopped.
+struct WorkHeartbeat
+{
+    CharString                  lockFile;
+    std::chrono::seconds        period;
+    std::mutex                  mutex;
+    std::condition_variable     condition;
+    bool                        isStopped;
+    std::thread                 thread;
+
+    WorkHeartbeat() :
+        lockFile(),
+        period(1),
+        isStopped(false)
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function chunkFileName()
+// ----------------------------------------------------------------------------
+
+// DIR/chunk-K.suffix, K from 1 padded to the width of the count so that the
+// files of the chunks are listed in order.
+inline CharString
+chunkFileName(WorkQueue const & me, unsigned chunk, CharString const & suffix)
+{
+    unsigned width = std::max<std::size_t>(4, std::to_string(me.chunks).size());
+    std::string number = std::to_string(chunk + 1);
+    number.insert(0, width - std::min<std::size_t>(width, number.size()), '0');
+
+    CharString name = me.dir;
+    append(name, "/chunk-");
+    append(name, number);
+    appendValue(name, '.');
+    append(name, suffix);
+    return name;
+}
+
+// The same, written by this process only: DIR/chunk-K.OWNER.suffix.
+inline CharString
+ownerFileName(WorkQueue const & me, unsigned chunk, CharString const & suffix)
+{
+    CharString name = me.owner;
+    appendValue(name, '.');
+    append(name, suffix);
+    return chunkFileName(me, chunk, name);
+}
+
+inline CharString _lockFileName(WorkQueue const & me, unsigned chunk,
+unsigned generation)
+{
+    return chunkFileName(me, chunk, CharString("lock." +
+        std::to_string(generation)));
+}
+
+// ----------------------------------------------------------------------------
+// Function _createExclusive()
+// ----------------------------------------------------------------------------
+
+// Create the file holding the owner, false when it exists.
+inline bool _createExclusive(WorkQueue const & me, CharString const & fileName)
+{
+#ifdef __linux__
+    int fd = ::open(toCString(fileName), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd == -1)
+    {
+        if (errno == EEXIST)
+            return false;
+        throw IOError("Error while creating file in work directory.");
+    }
+    CharString line = me.owner;
+    appendValue(line, '\n');
+    bool isWritten = ::write(fd, toCString(line), length(line)) ==
+        ssize_t(length(line));
+    ::close(fd);
+    if (!isWritten)
+        throw IOError("Error while creating file in work directory.");
+    return true;
+#else
+    ignoreUnusedVariableWarning(me);
+    ignoreUnusedVariableWarning(fileName);
+    throw IOError("Work directories are only supported on Linux.");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function _serverTime()
+// ----------------------------------------------------------------------------
+
+// Current time of the file system of the directory, the time of a probe file
+// touched then removed by this process, so that a lock is judged stale on the
+// clock which dated it whatever the clocks of the nodes.
+inline std::time_t _serverTime(WorkQueue const & me)
+{
+#ifdef __linux__
+    CharString probeFile = me.dir;
+    append(probeFile, "/clock." + std::string(toCString(me.owner)));
+    int fd = ::open(toCString(probeFile), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1)
+        throw IOError("Error while creating file in work directory.");
+    ::close(fd);
+
+    struct stat status;
+    bool isTouched =
+        ::utimensat(AT_FDCWD, toCString(probeFile), NULL, 0) == 0 &&
+        ::stat(toCString(probeFile), &status) == 0;
+    std::remove(toCString(probeFile));
+    if (!isTouched)
+        throw IOError("Error while creating file in work directory.");
+    return status.st_mtime;
+#else
+    ignoreUnusedVariableWarning(me);
+    throw IOError("Work directories are only supported on Linux.");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function open()
+// ----------------------------------------------------------------------------
+
+// Create the directory when it is missing and record the count of chunks in
+// DIR/chunks, so that all the processes cut the run the same way.
+inline void open(WorkQueue & me, char const * dir, unsigned chunks,
+unsigned timeout)
+{
+#ifdef __linux__
+    me.dir = dir;
+    me.chunks = chunks;
+    me.timeout = timeout;
+
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    me.owner = host;
+    append(me.owner, "." + std::to_string(getpid()));
+
+    if (::mkdir(dir, 0755) != 0 && errno != EEXIST)
+        throw IOError("Error while creating work directory.");
+
+    // Written aside then linked, the count is never read partial.
+    CharString countFile = me.dir;
+    append(countFile, "/chunks");
+    CharString tmpFile = countFile;
+    append(tmpFile, "." + std::string(toCString(me.owner)) + ".tmp");
+    {
+        std::ofstream file(toCString(tmpFile), std::ios::trunc);
+        file << chunks << '\n';
+    }
+    int linked = ::link(toCString(tmpFile), toCString(countFile));
+    int error = errno;
+    std::remove(toCString(tmpFile));
+    if (linked != 0 && error != EEXIST)
+        throw IOError("Error while creating work directory.");
+
+    unsigned count = 0;
+    std::ifstream file(toCString(countFile));
+    if (!(file >> count) || count != chunks)
+        throw RuntimeError("Error while opening work directory, it was cut "
+                           "in another number of chunks.");
+#else
+    ignoreUnusedVariableWarning(me);
+    ignoreUnusedVariableWarning(dir);
+    ignoreUnusedVariableWarning(chunks);
+    ignoreUnusedVariableWarning(timeout);
+    throw IOError("Work directories are only supported on Linux.");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function isDone()
+// ----------------------------------------------------------------------------
+
+inline bool isDone(WorkQueue const & me, unsigned chunk)
+{
+#ifdef __linux__
+    struct stat status;
+    return ::stat(toCString(chunkFileName(me, chunk, "done")), &status) == 0;
+#else
+    ignoreUnusedVariableWarning(me);
+    ignoreUnusedVariableWarning(chunk);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function claimChunk()
+// ----------------------------------------------------------------------------
+
+// Claim a chunk not done yet, neither held by a live owner.  Returns false
+// when another process got it, lockFile is set otherwise.
+inline bool claimChunk(CharString & lockFile, WorkQueue const & me,
+unsigned chunk)
+{
+#ifdef __linux__
+    if (isDone(me, chunk))
+        return false;
+
+    // Last generation of the lock, if any.
+    unsigned generation = 0;
+    struct stat status;
+    while (::stat(toCString(_lockFileName(me, chunk, generation)), &status)
+        == 0)
+        ++generation;
+
+    if (generation > 0)
+    {
+        ::stat(toCString(_lockFileName(me, chunk, generation - 1)), &status);
+        if (_serverTime(me) - status.st_mtime <= std::time_t(me.timeout))
+            return false;
+    }
+
+    lockFile = _lockFileName(me, chunk, generation);
+    return _createExclusive(me, lockFile);
+#else
+    ignoreUnusedVariableWarning(lockFile);
+    ignoreUnusedVariableWarning(me);
+    ignoreUnusedVariableWarning(chunk);
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function doneChunk()
+// ----------------------------------------------------------------------------
+
+// Called once the outputs of the chunk have their final names.  The chunk may
+// have been done already by a process which took it as stale.
+inline void doneChunk(WorkQueue const & me, unsigned chunk)
+{
+    _createExclusive(me, chunkFileName(me, chunk, "done"));
+}
+
+// ----------------------------------------------------------------------------
+// Function start()
+// ----------------------------------------------------------------------------
+
+inline void _refreshLock(CharString const & lockFile)
+{
+#ifdef __linux__
+    ::utimensat(AT_FDCWD, toCString(lockFile), NULL, 0);
+#else
+    ignoreUnusedVariableWarning(lockFile);
+#endif
+}
+
+inline void start(WorkHeartbeat & me, CharString const & lockFile,
+unsigned timeout)
+{
+    me.lockFile = lockFile;
+    me.period = std::chrono::seconds(std::max(1u, timeout / 4));
+    me.isStopped = false;
+    me.thread = std::thread([&me]()
+    {
+        std::unique_lock<std::mutex> lock(me.mutex);
+        while (!me.condition.wait_for(lock, me.period,
+            [&me]() { return me.isStopped; }))
+            _refreshLock(me.lockFile);
+    });
+}
+
+// ----------------------------------------------------------------------------
+// Function stop()
+// ----------------------------------------------------------------------------
+
+inline void stop(WorkHeartbeat & me)
+{
+    if (!me.thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(me.mutex);
+        me.isStopped = true;
+    }
+    me.condition.notify_all();
+    me.thread.join();
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_WORK_QUEUE_H_
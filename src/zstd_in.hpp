@@ -0,0 +1,330 @@
+// ============================================================================
+//                                HmnTrimmer
+// ============================================================================
+//
+// ============================================================================
+// Author: Gricourt Guillaume guillaume.gricourt@aphp.fr
+// ============================================================================
+// Comment: Read zstd files decompressed in parallel
+// ============================================================================
+#ifndef APP_HMNTRIMMER_ZSTD_IN_H_
+#define APP_HMNTRIMMER_ZSTD_IN_H_
+
+// ============================================================================
+// Prerequisites
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// STL headers
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if SEQAN_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// SeqAn headers
+// ----------------------------------------------------------------------------
+
+#include <seqan/parallel.h>
+#include <seqan/sequence.h>
+#include <seqan/stream.h>
+
+// ----------------------------------------------------------------------------
+// App headers
+// ----------------------------------------------------------------------------
+
+#include "block_out.hpp"
+#include "fastq_map.hpp"
+
+using namespace seqan;
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Class ZstdFrame
+// ----------------------------------------------------------------------------
+
+// A frame of size bytes at from, decompressed to contentSize bytes at offset.
+struct ZstdFrame
+{
+    std::size_t     from;
+    std::size_t     size;
+    std::size_t     contentSize;
+    std::size_t     offset;
+};
+
+// ----------------------------------------------------------------------------
+// Class ZstdFileIn
+// ----------------------------------------------------------------------------
+
+// A zstd FASTQ file mapped read-only and decompressed by rounds of about
+// roundSize bytes per thread.  Frames of known and small enough sizes, as the
+// ones written by BlockFileOut, are decompressed in parallel.  The others are
+// streamed by one thread, frameEnd being the end of the one in progress.  The
+// text is parsed as a partial FastqMap refilled at each round.
+struct ZstdFileIn
+{
+    char const *            data;
+    std::size_t             size;
+    int                     fd;
+    std::size_t             pos;
+    std::size_t             frameEnd;
+    CharString              buffer;
+    FastqMap                text;
+    String<ZstdFrame>       frames;
+    std::size_t             roundSize;
+    unsigned                threads;
+#if SEQAN_HAS_ZSTD
+    ZSTD_DStream *          stream;
+#endif
+
+    ZstdFileIn() :
+        data(NULL),
+        size(0),
+        fd(-1),
+        pos(0),
+        frameEnd(0),
+        buffer(),
+        text(),
+        frames(),
+        roundSize(4 << 20),
+        threads(1)
+#if SEQAN_HAS_ZSTD
+        , stream(NULL)
+#endif
+    {};
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// Function isOpen()
+// ----------------------------------------------------------------------------
+
+inline bool isOpen(ZstdFileIn const & me)
+{
+    return me.fd != -1;
+}
+
+// ----------------------------------------------------------------------------
+// Function setThreads()
+// ----------------------------------------------------------------------------
+
+// Threads of the team decompressing and parsing the next records, the file
+// may be open.
+inline void setThreads(ZstdFileIn & me, unsigned threads)
+{
+    me.threads = threads;
+    setThreads(me.text, threads);
+}
+
+// ----------------------------------------------------------------------------
+// Function close()
+// ----------------------------------------------------------------------------
+
+inline void close(ZstdFileIn & me)
+{
+    unmapFile(me.data, me.size, me.fd);
+    close(me.text);
+#if SEQAN_HAS_ZSTD
+    if (me.stream != NULL)
+        ZSTD_freeDStream(me.stream);
+#endif
+    unsigned threads = me.threads;
+    me = ZstdFileIn();
+    me.threads = threads;
+}
+
+// ----------------------------------------------------------------------------
+// Function open()
+// ----------------------------------------------------------------------------
+
+// Open regular files named *.zst and starting with a zstd frame only.
+inline bool open(ZstdFileIn & me, char const * fileName)
+{
+    close(me);
+    if (!isZstdName(fileName))
+        return false;
+#if SEQAN_HAS_ZSTD
+    if (!mapFile(me.data, me.size, me.fd, fileName))
+        return false;
+    static const char magic[4] = {0x28, char(0xb5), 0x2f, char(0xfd)};
+    if (me.size < 4 || std::memcmp(me.data, magic, 4) != 0)
+    {
+        close(me);
+        return false;
+    }
+
+    me.stream = ZSTD_createDStream();
+    me.text.threads = me.threads;
+    me.text.isPartial = true;
+    return me.stream != NULL;
+#else
+    return false;
+#endif
+}
+
+template <typename TSpec>
+inline bool open(Pair<ZstdFileIn, TSpec> & me,
+        const char * fileName1,
+        const char * fileName2)
+{
+    if (open(me.i1, fileName1) && open(me.i2, fileName2))
+        return true;
+    close(me.i1);
+    close(me.i2);
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// Function fillText()
+// ----------------------------------------------------------------------------
+
+// Decompress one round and append it to the text left to parse.
+inline void fillText(ZstdFileIn & me)
+{
+#if SEQAN_HAS_ZSTD
+    erase(me.buffer, 0, me.text.pos);
+    std::size_t offset = length(me.buffer);
+    std::size_t round = me.threads * me.roundSize;
+
+    // Frames with their size, up to a round.
+    clear(me.frames);
+    while (me.frameEnd == 0 && me.pos < me.size &&
+        offset - length(me.buffer) < round)
+    {
+        ZstdFrame frame;
+        frame.from = me.pos;
+        frame.size = ZSTD_findFrameCompressedSize(me.data + me.pos,
+            me.size - me.pos);
+        if (ZSTD_isError(frame.size))
+            throw IOError("Error while decompressing reads file.");
+        unsigned long long contentSize = ZSTD_getFrameContentSize(
+            me.data + me.pos, frame.size);
+        if (contentSize == ZSTD_CONTENTSIZE_ERROR)
+            throw IOError("Error while decompressing reads file.");
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+            contentSize > me.roundSize)
+        {
+            if (empty(me.frames))
+                me.frameEnd = me.pos + frame.size;
+            break;
+        }
+        frame.contentSize = contentSize;
+        frame.offset = offset;
+        offset += frame.contentSize;
+        me.pos += frame.size;
+        appendValue(me.frames, frame);
+    }
+    resize(me.buffer, offset);
+
+    std::atomic<bool> isFailed(false);
+    int frames = length(me.frames);
+    SEQAN_OMP_PRAGMA(parallel for schedule(dynamic) num_threads(me.threads))
+    for (int f = 0; f < frames; ++f)
+    {
+        ZstdFrame const & frame = me.frames[f];
+        std::size_t written = ZSTD_decompress(
+            begin(me.buffer, Standard()) + frame.offset, frame.contentSize,
+            me.data + frame.from, frame.size);
+        if (ZSTD_isError(written) || written != frame.contentSize)
+            isFailed = true;
+    }
+    if (isFailed)
+        throw IOError("Error while decompressing reads file.");
+
+    // Otherwise a round of the frame in progress.
+    if (frames == 0 && me.frameEnd != 0)
+    {
+        ZSTD_inBuffer in = {me.data, me.frameEnd, me.pos};
+        resize(me.buffer, offset + round);
+        ZSTD_outBuffer out = {begin(me.buffer, Standard()),
+            length(me.buffer), offset};
+        std::size_t status = 1;
+        while (status != 0 && out.pos < out.size)
+        {
+            std::size_t inPos = in.pos;
+            std::size_t outPos = out.pos;
+            status = ZSTD_decompressStream(me.stream, &out, &in);
+            if (ZSTD_isError(status) ||
+                (status != 0 && in.pos == inPos && out.pos == outPos))
+                throw IOError("Error while decompressing reads file.");
+        }
+        me.pos = in.pos;
+        if (status == 0)
+            me.frameEnd = 0;
+        resize(me.buffer, out.pos);
+    }
+
+    me.text.data = empty(me.buffer) ? NULL : toCString(me.buffer);
+    me.text.size = length(me.buffer);
+    me.text.pos = 0;
+    me.text.isPartial = me.pos < me.size;
+#else
+    ignoreUnusedVariableWarning(me);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Function readRecords()
+// ----------------------------------------------------------------------------
+
+// Read maxRecords records at most into the arenas, decompressing rounds
+// while the text left is short of a round.
+template <typename TNames, typename TSeqs, typename TSize>
+inline void
+readRecords(TNames & names, TSeqs & seqs, ZstdFileIn & me, TSize maxRecords)
+{
+    TSize count = 0;
+    while (count < maxRecords)
+    {
+        if (me.text.isPartial &&
+            me.text.size - me.text.pos < (std::size_t(me.threads) << 20))
+            fillText(me);
+
+        std::size_t before = length(names);
+        readRecords(names, seqs, me.text, maxRecords - count);
+        count += length(names) - before;
+        if (!me.text.isPartial)
+            break;
+        if (length(names) == before)
+            fillText(me);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Function skipRecords()
+// ----------------------------------------------------------------------------
+
+// Parse count records at most without keeping them, returns their number.
+template <typename TSize>
+inline TSize skipRecords(ZstdFileIn & me, TSize count)
+{
+    TSize skipped = 0;
+    FastqView view;
+    while (skipped < count)
+    {
+        if (me.text.isPartial &&
+            me.text.size - me.text.pos < (std::size_t(me.threads) << 20))
+            fillText(me);
+
+        if (readRecord(view, me.text))
+            ++skipped;
+        else if (!me.text.isPartial)
+            break;
+        else
+            fillText(me);
+    }
+    return skipped;
+}
+
+#endif  // #ifndef APP_HMNTRIMMER_ZSTD_IN_H_
@@ -6,7 +6,9 @@ import hashlib
 import json
 import logging
 import os
+import random
 import shutil
+import struct
 import subprocess
 import sys
 import tempfile
@@ -42,12 +44,13 @@ def md5ForFile(f, block_size=2**20):
 
 
 class TestConf(object):
-    def __init__(self, program, category, name, args, to_diff):
+    def __init__(self, program, category, name, args, to_diff, retcode=0):
         self.program = program
         self.category = category
         self.name = name
         self.args = args
         self.to_diff = to_diff
+        self.retcode = retcode
 
     def __repr__(self):
         fmt = "\tTest : %s - %s\n\tArgs : %s\n\tDiff : %s\n"
@@ -90,7 +93,7 @@ def runTest(test_conf):
         if stderr:
             stderr = stderr.decode("utf8")
         retcode = process.returncode
-        if retcode != 0:
+        if retcode != test_conf.retcode:
             return print_error(test_conf.commandLineArgs(), retcode, stdout, stderr)
     except Exception as e:
         # Print traceback.
@@ -102,8 +105,8 @@ def runTest(test_conf):
         logging.error(fmt % (" ".join(test_conf.commandLineArgs()), e))
         return False
 
-    # Handle error of program, indicated by return code != 0.
-    if retcode != 0:
+    # Handle error of program, indicated by an unexpected return code.
+    if retcode != test_conf.retcode:
         return print_error(test_conf.commandLineArgs(), retcode, stdout, stderr)
 
     # Compare results with expected results, if the expected and actual result
@@ -121,6 +124,8 @@ def runTest(test_conf):
                 mode = "empty"
             elif tuple_[2] == "json":
                 mode = "json"
+            elif tuple_[2] == "checkpoints":
+                mode = "checkpoints"
         try:
             if mode == "gzip":
                 f = gzip.open(expected_path, "rb")
@@ -166,6 +171,18 @@ def runTest(test_conf):
                 else:
                     logging.error("File %s is not empty" % (result_path,))
                     return False
+            elif mode == "checkpoints":
+                # Count of a gzip index after its magic and four fields.
+                with open(result_path, "rb") as fid:
+                    count = struct.unpack("<Q", fid.read(48)[40:])[0]
+                if count >= int(expected_path):
+                    results.append(0)
+                else:
+                    logging.error(
+                        "Index %s has %d checkpoints, less than %s"
+                        % (result_path, count, expected_path)
+                    )
+                    return False
             elif mode == "json":
                 with open(expected_path) as fid:
                     expected_json = json.load(fid)
@@ -193,6 +210,11 @@ def clean_up_files(files):
     files = []
 
 
+def clean_up_dirs(dirs):
+    for dirname in dirs:
+        shutil.rmtree(dirname)
+
+
 def create_tmp_files(temp_files, files, nb=1, exts=None):
     files.clear()
     if type(exts) == str:
@@ -218,6 +240,7 @@ def main():
     # Init var.
     conf_list = []
     TMPFILES, temp_files = [], []  # First is global, second is purposed for each test
+    TMPDIRS = []
 
     # ============================================================
     # GenTrim.
@@ -436,6 +459,40 @@ def main():
     )
     conf_list.append(conf)
 
+    # D. Mate 2 of a pair discarded for mate 1 trimmed all the same.
+    create_tmp_files(TMPFILES, temp_files, 6, ".fastq")
+    discard_seq = "ACGT" * 12 + "AC"
+    with open(temp_files[0], "w") as fo:
+        fo.write("@pair/1\n%s\n+\n%s\n" % ("N" * 30, "I" * 30))
+    with open(temp_files[1], "w") as fo:
+        fo.write("@pair/2\n%s\n+\n%s\n" % (discard_seq, "I" * 30 + "#" * 20))
+    with open(temp_files[2], "w") as fo:
+        fo.write("@pair/1\\1\n%s\n+\n%s\n" % ("N" * 30, "!" * 30))
+        fo.write("@pair/2\\2\n%s\n+\n%s\n" % (discard_seq[:30], "I" * 30))
+    conf = TestConf(
+        program=path_program,
+        category="GenDiscard",
+        name="D",
+        args=[
+            "--input-fastq-forward",
+            temp_files[0],
+            "--input-fastq-reverse",
+            temp_files[1],
+            "--output-fastq-discard",
+            temp_files[3],
+            "--output-fastq-forward",
+            temp_files[4],
+            "--output-fastq-reverse",
+            temp_files[5],
+            "--quality-tail",
+            "20:3",
+            "--information-n",
+            "5",
+        ],
+        to_diff=[(temp_files[2], temp_files[3])],
+    )
+    conf_list.append(conf)
+
     # ============================================================
     # GenFormat.
     # ============================================================
@@ -538,6 +595,29 @@ def main():
     )
     conf_list.append(conf)
 
+    # E, F.
+    tests = [
+        ("E", "10", os.path.join(path_gold_input, "LENGTHMIN.Interleaved.fastq")),
+        ("F", "50", os.path.join(path_gold_output, "LENGTHMIN-B.Interleaved.fastq")),
+    ]
+    for test in tests:
+        create_tmp_files(TMPFILES, temp_files, 1, ".fastq")
+        conf = TestConf(
+            program=path_program,
+            category="GenFormat",
+            name=test[0],
+            args=[
+                "--input-fastq-interleaved",
+                os.path.join(path_gold_input, "LENGTHMIN.Interleaved.fastq"),
+                "--output-fastq-interleaved",
+                temp_files[0],
+                "--length-min",
+                test[1],
+            ],
+            to_diff=[(test[2], temp_files[0])],
+        )
+        conf_list.append(conf)
+
     # ============================================================
     # GenThread.
     # ============================================================
@@ -606,6 +686,95 @@ def main():
             ],
         )
         conf_list.append(conf)
+    # I.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    conf = TestConf(
+        program=path_program,
+        category="GenThread",
+        name="I",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--reads-batch",
+            "100",
+            "--batch-buffers",
+            "2",
+            "--threads",
+            "4",
+            "--length-min",
+            "55",
+        ],
+        to_diff=[
+            (os.path.join(path_gold_output, "BIG-B.R1.fastq"), temp_files[0]),
+            (os.path.join(path_gold_output, "BIG-B.R2.fastq"), temp_files[1]),
+        ],
+    )
+    conf_list.append(conf)
+    # J, K.
+    for name, thread in [("J", "16"), ("K", "auto")]:
+        create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+        conf = TestConf(
+            program=path_program,
+            category="GenThread",
+            name=name,
+            args=[
+                "--input-fastq-forward",
+                os.path.join(path_gold_input, "BIG.R1.fastq"),
+                "--input-fastq-reverse",
+                os.path.join(path_gold_input, "BIG.R2.fastq"),
+                "--output-fastq-forward",
+                temp_files[0],
+                "--output-fastq-reverse",
+                temp_files[1],
+                "--reads-batch",
+                "100",
+                "--threads",
+                thread,
+                "--pin-threads",
+                "--length-min",
+                "55",
+            ],
+            to_diff=[
+                (os.path.join(path_gold_output, "BIG-B.R1.fastq"), temp_files[0]),
+                (os.path.join(path_gold_output, "BIG-B.R2.fastq"), temp_files[1]),
+            ],
+        )
+        conf_list.append(conf)
+    # L.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    conf = TestConf(
+        program=path_program,
+        category="GenThread",
+        name="L",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--batch-memory",
+            "1",
+            "--threads",
+            "4",
+            "--length-min",
+            "55",
+        ],
+        to_diff=[
+            (os.path.join(path_gold_output, "BIG-B.R1.fastq"), temp_files[0]),
+            (os.path.join(path_gold_output, "BIG-B.R2.fastq"), temp_files[1]),
+        ],
+    )
+    conf_list.append(conf)
+
     # ============================================================
     # GenCompress.
     # ============================================================
@@ -698,6 +867,417 @@ def main():
     )
     conf_list.append(conf)
 
+    # D.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq.gz")
+    conf = TestConf(
+        program=path_program,
+        category="GenCompress",
+        name="D",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--length-min",
+            "55",
+            "--threads",
+            "4",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "BIG-B.R1.fastq.gz"),
+                temp_files[0],
+                "gzip",
+            ),
+            (
+                os.path.join(path_gold_output, "BIG-B.R2.fastq.gz"),
+                temp_files[1],
+                "gzip",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+
+    # E.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    conf = TestConf(
+        program=path_program,
+        category="GenCompress",
+        name="E",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq.gz"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq.gz"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--length-min",
+            "10",
+            "--threads",
+            "4",
+        ],
+        to_diff=[
+            (os.path.join(path_gold_input, "BIG.R1.fastq"), temp_files[0]),
+            (os.path.join(path_gold_input, "BIG.R2.fastq"), temp_files[1]),
+        ],
+    )
+    conf_list.append(conf)
+
+    # F.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq.bgz")
+    conf = TestConf(
+        program=path_program,
+        category="GenCompress",
+        name="F",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--length-min",
+            "55",
+            "--threads",
+            "4",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "BIG-B.R1.fastq.gz"),
+                temp_files[0],
+                "gzip",
+            ),
+            (
+                os.path.join(path_gold_output, "BIG-B.R2.fastq.gz"),
+                temp_files[1],
+                "gzip",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+
+    # G.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq.zst")
+    zstd_files = list(temp_files)
+    conf = TestConf(
+        program=path_program,
+        category="GenCompress",
+        name="G",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "BIG.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "BIG.R2.fastq"),
+            "--output-fastq-forward",
+            zstd_files[0],
+            "--output-fastq-reverse",
+            zstd_files[1],
+            "--length-min",
+            "55",
+            "--threads",
+            "4",
+            "--zstd-level",
+            "5",
+        ],
+        to_diff=[],
+    )
+    conf_list.append(conf)
+    # H, reads back G.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    conf = TestConf(
+        program=path_program,
+        category="GenCompress",
+        name="H",
+        args=[
+            "--input-fastq-forward",
+            zstd_files[0],
+            "--input-fastq-reverse",
+            zstd_files[1],
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--length-min",
+            "10",
+            "--threads",
+            "4",
+        ],
+        to_diff=[
+            (os.path.join(path_gold_output, "BIG-B.R1.fastq"), temp_files[0]),
+            (os.path.join(path_gold_output, "BIG-B.R2.fastq"), temp_files[1]),
+        ],
+    )
+    conf_list.append(conf)
+
+    # ============================================================
+    # GenIndex.
+    # ============================================================
+    # Gzip inputs copied with their index, reads from 3000 expected.
+    create_tmp_files(TMPFILES, temp_files, 4, ".fastq.gz")
+    index_files = list(temp_files)
+    for x, mate in enumerate(["R1", "R2"]):
+        shutil.copy(
+            os.path.join(path_gold_input, "BIG.%s.fastq.gz" % (mate,)),
+            index_files[x],
+        )
+        open(index_files[x] + ".hmi", "wb").close()
+        TMPFILES.append(index_files[x] + ".hmi")
+        with open(os.path.join(path_gold_input, "BIG.%s.fastq" % (mate,))) as fi:
+            with open(index_files[x + 2], "w") as fo:
+                fo.writelines(fi.readlines()[4 * 3000 :])
+    # A, index built while reading.
+    # B, index used.
+    for name in ["A", "B"]:
+        create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+        conf = TestConf(
+            program=path_program,
+            category="GenIndex",
+            name=name,
+            args=[
+                "--input-fastq-forward",
+                index_files[0],
+                "--input-fastq-reverse",
+                index_files[1],
+                "--output-fastq-forward",
+                temp_files[0],
+                "--output-fastq-reverse",
+                temp_files[1],
+                "--length-min",
+                "10",
+                "--gzip-index",
+                "--gzip-index-span",
+                "1",
+                "--record-start",
+                "3000",
+            ],
+            to_diff=[
+                (index_files[2], temp_files[0]),
+                (index_files[3], temp_files[1]),
+            ],
+        )
+        conf_list.append(conf)
+    # C and D, a checkpoint about every span of a 12.8 MB file, whatever the
+    # number of threads building the index.
+    with open(os.path.join(path_gold_input, "BIG.R1.fastq"), "rb") as fi:
+        span_text = fi.read() * 8
+    for name, threads in [("C", "1"), ("D", "4")]:
+        create_tmp_files(TMPFILES, temp_files, 1, ".fastq.gz")
+        span_file = temp_files[0]
+        TMPFILES.append(span_file + ".hmi")
+        with gzip.open(span_file, "wb", compresslevel=1) as fo:
+            fo.write(span_text)
+        conf = TestConf(
+            program=path_program,
+            category="GenIndex",
+            name=name,
+            args=[
+                "--input-fastq-forward",
+                span_file,
+                "--gzip-index-only",
+                "--gzip-index-span",
+                "1",
+                "--threads",
+                threads,
+            ],
+            to_diff=[("10", span_file + ".hmi", "checkpoints")],
+        )
+        conf_list.append(conf)
+
+    # ============================================================
+    # GenShard.
+    # ============================================================
+    # A and B, shards of ReportFile A.
+    shard_reports = []
+    for name, shard in [("A", "1/2"), ("B", "2/2")]:
+        create_tmp_files(TMPFILES, temp_files, 3, [".fastq", ".fastq", ".json"])
+        shard_reports.append(temp_files[2])
+        conf = TestConf(
+            program=path_program,
+            category="GenShard",
+            name=name,
+            args=[
+                "--input-fastq-forward",
+                os.path.join(path_gold_input, "QUALTAIL.R1.fastq"),
+                "--input-fastq-reverse",
+                os.path.join(path_gold_input, "QUALTAIL.R2.fastq"),
+                "--output-fastq-forward",
+                temp_files[0],
+                "--output-fastq-reverse",
+                temp_files[1],
+                "--output-report",
+                temp_files[2],
+                "--quality-tail",
+                "5:5:70",
+                "--shard",
+                shard,
+            ],
+            to_diff=[],
+        )
+        conf_list.append(conf)
+    # C, merge of their reports.
+    create_tmp_files(TMPFILES, temp_files, 1, ".json")
+    conf = TestConf(
+        program=path_program,
+        category="GenShard",
+        name="C",
+        args=[
+            "--report-merge",
+            shard_reports[0],
+            "--report-merge",
+            shard_reports[1],
+            "--output-report",
+            temp_files[0],
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "ReportFile-A.json"),
+                temp_files[0],
+                "json",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+
+    # ============================================================
+    # GenWorkDir.
+    # ============================================================
+    # A, one chunk is the whole run.
+    work_dir = tempfile.mkdtemp()
+    TMPDIRS.append(work_dir)
+    conf = TestConf(
+        program=path_program,
+        category="GenWorkDir",
+        name="A",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "QUALTAIL.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "QUALTAIL.R2.fastq"),
+            "--output-fastq-forward",
+            "out.R1.fastq",
+            "--output-fastq-reverse",
+            "out.R2.fastq",
+            "--quality-tail",
+            "2:2",
+            "--work-dir",
+            work_dir,
+            "--work-chunks",
+            "1",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "QUALTAIL-A.R1.fastq"),
+                os.path.join(work_dir, "chunk-0001.out.R1.fastq"),
+            ),
+            (
+                os.path.join(path_gold_output, "QUALTAIL-A.R2.fastq"),
+                os.path.join(work_dir, "chunk-0001.out.R2.fastq"),
+            ),
+        ],
+    )
+    conf_list.append(conf)
+    # B, report merged from the chunks.
+    work_dir = tempfile.mkdtemp()
+    TMPDIRS.append(work_dir)
+    create_tmp_files(TMPFILES, temp_files, 1, ".json")
+    conf = TestConf(
+        program=path_program,
+        category="GenWorkDir",
+        name="B",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "QUALTAIL.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "QUALTAIL.R2.fastq"),
+            "--output-fastq-forward",
+            "out.R1.fastq",
+            "--output-fastq-reverse",
+            "out.R2.fastq",
+            "--output-report",
+            temp_files[0],
+            "--quality-tail",
+            "5:5:70",
+            "--work-dir",
+            work_dir,
+            "--work-chunks",
+            "3",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "ReportFile-A.json"),
+                temp_files[0],
+                "json",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+    # C, report merged again by a run on the directory of B, all done.
+    create_tmp_files(TMPFILES, temp_files, 1, ".json")
+    conf = TestConf(
+        program=path_program,
+        category="GenWorkDir",
+        name="C",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "QUALTAIL.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "QUALTAIL.R2.fastq"),
+            "--output-fastq-forward",
+            "out.R1.fastq",
+            "--output-fastq-reverse",
+            "out.R2.fastq",
+            "--output-report",
+            temp_files[0],
+            "--quality-tail",
+            "5:5:70",
+            "--work-dir",
+            work_dir,
+            "--work-chunks",
+            "3",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "ReportFile-A.json"),
+                temp_files[0],
+                "json",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+    # D, zstd input from GenCompress G is not cut in chunks.
+    work_dir = tempfile.mkdtemp()
+    TMPDIRS.append(work_dir)
+    conf = TestConf(
+        program=path_program,
+        category="GenWorkDir",
+        name="D",
+        args=[
+            "--input-fastq-forward",
+            zstd_files[0],
+            "--input-fastq-reverse",
+            zstd_files[1],
+            "--output-fastq-forward",
+            "out.R1.fastq",
+            "--output-fastq-reverse",
+            "out.R2.fastq",
+            "--length-min",
+            "10",
+            "--work-dir",
+            work_dir,
+        ],
+        to_diff=[],
+        retcode=1,
+    )
+    conf_list.append(conf)
+
     # ============================================================
     # TrimLengthMin.
     # ============================================================
@@ -1339,6 +1919,164 @@ def main():
     )
     conf_list.append(conf)
 
+    # ============================================================
+    # Simd.
+    # ============================================================
+
+    # A.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    conf = TestConf(
+        program=path_program,
+        category="Simd",
+        name="A",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "QUALSLD.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "QUALSLD.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--quality-sliding-window",
+            "20:25",
+            "--simd",
+            "scalar",
+        ],
+        to_diff=[
+            (os.path.join(path_gold_output, "QUALSLD-A.R1.fastq"), temp_files[0]),
+            (os.path.join(path_gold_output, "QUALSLD-A.R2.fastq"), temp_files[1]),
+        ],
+    )
+    conf_list.append(conf)
+    # B.
+    create_tmp_files(TMPFILES, temp_files, 3, [".fastq", ".fastq", ".json"])
+    conf = TestConf(
+        program=path_program,
+        category="Simd",
+        name="B",
+        args=[
+            "--input-fastq-forward",
+            os.path.join(path_gold_input, "QUALTAIL.R1.fastq"),
+            "--input-fastq-reverse",
+            os.path.join(path_gold_input, "QUALTAIL.R2.fastq"),
+            "--output-fastq-forward",
+            temp_files[0],
+            "--output-fastq-reverse",
+            temp_files[1],
+            "--output-report",
+            temp_files[2],
+            "--quality-tail",
+            "5:5:70",
+            "--simd",
+            "sse2",
+        ],
+        to_diff=[
+            (
+                os.path.join(path_gold_output, "ReportFile-A.json"),
+                temp_files[2],
+                "json",
+            ),
+        ],
+    )
+    conf_list.append(conf)
+
+    # Reads of lengths around the vector widths, with low quality tails,
+    # windows and N, generated.
+    create_tmp_files(TMPFILES, temp_files, 2, ".fastq")
+    simd_inputs = list(temp_files)
+    simd_random = random.Random(25)
+    simd_lengths = [1, 7, 15, 17, 31, 33, 47, 63, 65, 95, 97, 127, 129, 150, 191]
+    simd_lengths += [255, 257, 300]
+    for x, simd_input in enumerate(simd_inputs):
+        with open(simd_input, "w") as fo:
+            for y in range(600):
+                length = simd_lengths[y % len(simd_lengths)]
+                seq = [simd_random.choice("ACGT") for _ in range(length)]
+                qual = [simd_random.randint(25, 40) for _ in range(length)]
+                for _ in range(simd_random.randint(0, 3)):
+                    seq[simd_random.randrange(length)] = "N"
+                start = simd_random.randint(0, length)
+                for z in range(start, length):
+                    qual[z] = simd_random.randint(2, 22)
+                if y % 3 == 0:
+                    start = simd_random.randint(0, length)
+                    for z in range(start, min(length, start + 12)):
+                        seq[z] = "A"
+                fo.write("@simd%d/%d\n%s\n+\n" % (y, x + 1, "".join(seq)))
+                fo.write("".join(chr(q + 33) for q in qual) + "\n")
+    # C. Reference with the scalar set.
+    create_tmp_files(TMPFILES, temp_files, 3, [".fastq", ".fastq", ".json"])
+    simd_args = [
+        "--input-fastq-forward",
+        simd_inputs[0],
+        "--input-fastq-reverse",
+        simd_inputs[1],
+        "--quality-tail",
+        "20:3",
+        "--quality-sliding-window",
+        "20:7",
+        "--information-n",
+        "3",
+        "--information-dust",
+        "5",
+        "--length-min",
+        "10",
+    ]
+    simd_files = list(temp_files)
+    conf = TestConf(
+        program=path_program,
+        category="Simd",
+        name="C",
+        args=simd_args
+        + [
+            "--output-fastq-forward",
+            simd_files[0],
+            "--output-fastq-reverse",
+            simd_files[1],
+            "--output-report",
+            simd_files[2],
+            "--simd",
+            "scalar",
+        ],
+        to_diff=[],
+    )
+    conf_list.append(conf)
+    # D, E. Same outputs with the sets of the CPU.
+    cpu_flags = set()
+    if os.path.exists("/proc/cpuinfo"):
+        with open("/proc/cpuinfo") as fid:
+            for line in fid:
+                if line.startswith("flags"):
+                    cpu_flags.update(line.split(":", 1)[1].split())
+    for name, level, flag in [("D", "avx2", "avx2"), ("E", "avx512", "avx512bw")]:
+        if flag not in cpu_flags:
+            logging.info("Test Simd %s\tskipped, no %s" % (name, flag))
+            continue
+        create_tmp_files(TMPFILES, temp_files, 3, [".fastq", ".fastq", ".json"])
+        conf = TestConf(
+            program=path_program,
+            category="Simd",
+            name=name,
+            args=simd_args
+            + [
+                "--output-fastq-forward",
+                temp_files[0],
+                "--output-fastq-reverse",
+                temp_files[1],
+                "--output-report",
+                temp_files[2],
+                "--simd",
+                level,
+            ],
+            to_diff=[
+                (simd_files[0], temp_files[0]),
+                (simd_files[1], temp_files[1]),
+                (simd_files[2], temp_files[2], "json"),
+            ],
+        )
+        conf_list.append(conf)
+
     # ============================================================
     # Execute the tests.
     # ============================================================
@@ -1374,6 +2112,7 @@ def main():
     # Cleanup.
     logging.debug("Clean up.")
     clean_up_files(TMPFILES)
+    clean_up_dirs(TMPDIRS)
 
     logging.info("==============================")
     logging.info("     total tests: %s" % (len(conf_list),))